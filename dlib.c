@@ -8,9 +8,20 @@
 #include <errno.h>		/* errno */
 #include <time.h>		/* clock_t, clock */
 #include <stdarg.h>		/* va_start etc. */
+#include <unistd.h>		/* unlink, rmdir, getpid */
 #ifndef _NO_MUSABLE
 #include <malloc.h>		/* malloc_usable_size */
 #endif
+#ifndef _NO_PTHREAD
+#include <pthread.h>		/* pthread_create, pthread_join */
+#endif
+#ifndef _NO_MMAP
+#include <sys/mman.h>		/* mmap, munmap */
+#endif
+#include <sys/stat.h>		/* fstat */
+#ifndef _NO_ZLIB
+#include <zlib.h>		/* gzopen, gzgets, gzputs, gzclose */
+#endif
 
 /*** msg and die support code */
 
@@ -71,13 +82,16 @@ void _d_error(int status, int errnum, const char *format, ...) {
 
 int64_t _d_memsize = 0;
 
+/* Tables may allocate from multiple threads (e.g. xmerge_all). */
+#define _d_memadd(n) ((void) _d_xadd(&_d_memsize, (int64_t) (n)))
+
 void *_d_malloc(size_t size) {
   void *ptr = malloc(size);
   if (ptr == NULL) 
     die("Cannot allocate %zu bytes", size);
 #ifndef NDEBUG
 #ifndef _NO_MUSABLE
-  _d_memsize += malloc_usable_size(ptr);
+  _d_memadd(malloc_usable_size(ptr));
 #endif
 #endif
   return ptr;
@@ -87,7 +101,7 @@ char *_d_strdup(const char *s) {
   char *a = strdup(s);
 #ifndef NDEBUG
 #ifndef _NO_MUSABLE
-  _d_memsize += malloc_usable_size(a);
+  _d_memadd(malloc_usable_size(a));
 #endif
 #endif
   return a;
@@ -99,7 +113,7 @@ void *_d_calloc(size_t nmemb, size_t size) {
     die("Cannot allocate %zu bytes", nmemb*size);
 #ifndef NDEBUG
 #ifndef _NO_MUSABLE
-  _d_memsize += malloc_usable_size(ptr);
+  _d_memadd(malloc_usable_size(ptr));
 #endif
 #endif
   return ptr;
@@ -108,7 +122,7 @@ void *_d_calloc(size_t nmemb, size_t size) {
 void *_d_realloc(void *ptr, size_t size) {
 #ifndef NDEBUG
 #ifndef _NO_MUSABLE
-  _d_memsize -= malloc_usable_size(ptr);
+  _d_memadd(-(int64_t) malloc_usable_size(ptr));
 #endif
 #endif
   void *ptr2 = realloc(ptr, size);
@@ -116,7 +130,7 @@ void *_d_realloc(void *ptr, size_t size) {
     die("Cannot allocate %zu bytes", size);
 #ifndef NDEBUG
 #ifndef _NO_MUSABLE
-  _d_memsize += malloc_usable_size(ptr2);
+  _d_memadd(malloc_usable_size(ptr2));
 #endif
 #endif
   return ptr2;
@@ -127,12 +141,44 @@ void _d_free(void *ptr) {
 #ifndef _NO_MUSABLE
   // This may fail if multithreaded  
   // assert(_d_memsize >= malloc_usable_size(ptr));
-  _d_memsize -= malloc_usable_size(ptr);
+  _d_memadd(-(int64_t) malloc_usable_size(ptr));
 #endif
 #endif
   free(ptr);
 }
 
+/* Pruning callbacks run one at a time: a thread that finds another
+   one pruning (or the callbacks growing a table, or an xget_batch in
+   progress) goes on without them. */
+
+size_t _d_membudget = 0;
+static struct { void (*fn)(void *); void *arg; } *_d_prune;
+static size_t _d_nprune;
+int _d_pruning = 0;
+
+void dmembudget(size_t nbytes) {
+  _d_membudget = nbytes;
+  if (nbytes != 0) return;
+  _d_free(_d_prune);
+  _d_prune = NULL;
+  _d_nprune = 0;
+}
+
+void dmemprune(void (*fn)(void *arg), void *arg) {
+  _d_prune = _d_realloc(_d_prune, (_d_nprune + 1) * sizeof(*_d_prune));
+  _d_prune[_d_nprune].fn = fn;
+  _d_prune[_d_nprune++].arg = arg;
+}
+
+void _d_memprune(size_t n) {
+  if (!_d_cas(&_d_pruning, 0, 1)) return;
+  for (size_t i = 0; i < _d_nprune; i++) {
+    if (_d_memsize + (int64_t) n <= (int64_t) _d_membudget) break;
+    _d_prune[i].fn(_d_prune[i].arg);
+  }
+  _d_store(&_d_pruning, 0);
+}
+
 /*** forline support code */
 
 struct _D_FILE_S {
@@ -267,6 +313,392 @@ size_t fnv1a(const char *k) {
   return hash;
 }
 
+/* wyhash (final version 4 by Wang Yi, public domain): reads 8 bytes
+   at a time and mixes them with 64x64->128 bit multiplications. */
+
+static const uint64_t _wyp[4] = {
+  0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+  0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL };
+
+static inline void _wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = *a; r *= *b;
+  *a = (uint64_t) r; *b = (uint64_t) (r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32); c += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  *a = lo; *b = hi;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b) { _wymum(&a, &b); return a ^ b; }
+static inline uint64_t _wyr8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t _wyr4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t _wyr3(const uint8_t *p, size_t k) {
+  return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+size_t wyhash(const void *key, size_t len, uint64_t seed) {
+  const uint8_t *p = (const uint8_t *) key;
+  uint64_t a, b;
+  seed ^= _wymix(seed ^ _wyp[0], _wyp[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (_wyr4(p) << 32) | _wyr4(p + ((len >> 3) << 2));
+      b = (_wyr4(p + len - 4) << 32) | _wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = _wyr3(p, len); b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+	seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+	see1 = _wymix(_wyr8(p + 16) ^ _wyp[2], _wyr8(p + 24) ^ see1);
+	see2 = _wymix(_wyr8(p + 32) ^ _wyp[3], _wyr8(p + 40) ^ see2);
+	p += 48; i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+      i -= 16; p += 16;
+    }
+    a = _wyr8(p + i - 16); b = _wyr8(p + i - 8);
+  }
+  a ^= _wyp[1]; b ^= seed;
+  _wymum(&a, &b);
+  return _wymix(a ^ _wyp[0] ^ len, b ^ _wyp[1]);
+}
+
+size_t strhash(const char *k) {
+  return wyhash(k, strlen(k), 0);
+}
+
+/*** parallel operations */
+
+size_t _d_nthreads = 1;
+
+void dthreads(size_t n) {
+#ifndef _NO_PTHREAD
+  _d_nthreads = (n == 0) ? 1 : n;
+#else
+  (void) n;
+#endif
+}
+
+#ifndef _NO_PTHREAD
+struct _d_thread_s {
+  void (*fn)(void *, size_t, size_t);
+  void *arg;
+  size_t tid, n;
+  bool joinable;
+  pthread_t thread;
+};
+
+static void *_d_thread(void *p) {
+  struct _d_thread_s *t = p;
+  t->fn(t->arg, t->tid, t->n);
+  return NULL;
+}
+#endif
+
+void _d_parallel(void (*fn)(void *arg, size_t tid, size_t n), void *arg) {
+#ifndef _NO_PTHREAD
+  size_t n = _d_nthreads;
+  if (n > 1) {
+    struct _d_thread_s *t = _d_malloc(n * sizeof(struct _d_thread_s));
+    for (size_t i = 1; i < n; i++) {
+      t[i].fn = fn; t[i].arg = arg; t[i].tid = i; t[i].n = n;
+      t[i].joinable = false;
+      // If we cannot create a thread, do its share of the work here.
+      if (pthread_create(&t[i].thread, NULL, _d_thread, &t[i]) == 0)
+	t[i].joinable = true;
+      else
+	fn(arg, i, n);
+    }
+    fn(arg, 0, n);
+    for (size_t i = 1; i < n; i++)
+      if (t[i].joinable) pthread_join(t[i].thread, NULL);
+    _d_free(t);
+    return;
+  }
+#endif
+  fn(arg, 0, 1);
+}
+
+/*** concurrent hash tables */
+
+dchash_t _d_dchash(size_t nmemb, size_t esize) {
+  if (nmemb >= (1ULL << _D_LENBITS))
+    die("dchash_t cannot hold more than %lu elements.", (1ULL<<_D_LENBITS));
+  dchash_t h = _d_malloc(sizeof(struct dchash_s));
+  size_t b; for (b = 4; (1ULL << b) < nmemb; b++);
+  h->a.bits = (b << _D_LENBITS);
+  size_t c = (1ULL << b);
+  h->a.data = _d_malloc(c * (esize + 1));
+  memset(((char *) h->a.data) + c * esize, 0, c);
+  h->lock = NULL;
+#ifndef _NO_PTHREAD
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+  // Readers should not starve a thread waiting to resize the table.
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  h->lock = _d_malloc(sizeof(pthread_rwlock_t));
+  if (pthread_rwlock_init(h->lock, &attr))
+    die("Cannot initialize dchash_t lock");
+  pthread_rwlockattr_destroy(&attr);
+#endif
+  return h;
+}
+
+void dchash_free(dchash_t h) {
+#ifndef _NO_PTHREAD
+  pthread_rwlock_destroy(h->lock);
+  _d_free(h->lock);
+#endif
+  _d_free(h->a.data); _d_free(h);
+}
+
+/* The lock is kept behind a pointer so that dlib.h does not need
+   pthread.h (whose rwlocks are not visible under plain -std=c99). */
+
+#ifdef _NO_PTHREAD
+void _d_rdlock(dchash_t h) { (void) h; }
+void _d_wrlock(dchash_t h) { (void) h; }
+void _d_unlock(dchash_t h) { (void) h; }
+#else
+void _d_rdlock(dchash_t h) { pthread_rwlock_rdlock(h->lock); }
+void _d_wrlock(dchash_t h) { pthread_rwlock_wrlock(h->lock); }
+void _d_unlock(dchash_t h) { pthread_rwlock_unlock(h->lock); }
+#endif
+
+/*** Bloom filters */
+
+dbloom_t bloom_new(size_t n) {
+  dbloom_t b = _d_malloc(sizeof(struct dbloom_s));
+  size_t nb = 1;
+  while (nb * 512 < n * D_BLOOMBITS) nb <<= 1;
+  b->mem = _d_calloc(nb * 8 + 8, sizeof(uint64_t));
+  b->blk = (uint64_t *) (((uintptr_t) b->mem + 63) & ~(uintptr_t) 63);
+  b->mask = nb - 1;
+  return b;
+}
+
+void bloom_free(dbloom_t b) {
+  _d_free(b->mem); _d_free(b);
+}
+
+/*** frozen hash tables */
+
+/* Find displacements for a minimal perfect hash of n keys with hash
+   values hv into nb buckets and return the slot of each key in pos.
+   A key with the same hash value as an earlier key of its bucket
+   cannot be told apart from it by _d_mphpos, so it goes to one of the
+   disp[nb] fallback slots at the end and the displacements only place
+   the other m = n - disp[nb] keys in the first m slots.  Buckets are
+   placed largest first, when most slots are still free; the last ones
+   are singletons that only need a free slot. */
+
+void _d_mph(const size_t *hv, size_t n, size_t nb, uint32_t *disp, size_t *pos) {
+  size_t *start = _d_calloc(nb + 1, sizeof(size_t));
+  for (size_t i = 0; i < n; i++) start[_d_mphbucket(hv[i], nb) + 1]++;
+  for (size_t b = 0; b < nb; b++) start[b + 1] += start[b];
+  size_t *keys = _d_malloc(n * sizeof(size_t));
+  size_t *next = _d_malloc(nb * sizeof(size_t));
+  memcpy(next, start, nb * sizeof(size_t));
+  for (size_t i = 0; i < n; i++) keys[next[_d_mphbucket(hv[i], nb)]++] = i;
+  size_t *size = _d_malloc(nb * sizeof(size_t));
+  size_t maxsize = 0, ndup = 0;
+  for (size_t b = 0; b < nb; b++) {
+    size_t *k = &keys[start[b]], s = 0;
+    for (size_t i = 0, j; i < start[b + 1] - start[b]; i++) {
+      for (j = 0; (j < s) && (hv[k[j]] != hv[k[i]]); j++);
+      if (j < s) { ndup++; continue; }
+      size_t t = k[s]; k[s++] = k[i]; k[i] = t;
+    }
+    size[b] = s;
+    if (s > maxsize) maxsize = s;
+  }
+  if (ndup > UINT32_MAX) die("xfreeze: %zu keys share their hash value", ndup);
+  size_t m = n - ndup, f = m;
+  for (size_t b = 0; b < nb; b++)
+    for (size_t i = start[b] + size[b]; i < start[b + 1]; i++) pos[keys[i]] = f++;
+  disp[nb] = ndup;
+  size_t *bysize = _d_calloc(maxsize + 2, sizeof(size_t));
+  for (size_t b = 0; b < nb; b++) bysize[maxsize - size[b] + 1]++;
+  for (size_t s = 0; s <= maxsize; s++) bysize[s + 1] += bysize[s];
+  size_t *order = next;
+  for (size_t b = 0; b < nb; b++) order[bysize[maxsize - size[b]]++] = b;
+  uint8_t *taken = _d_calloc(n, 1);
+  size_t *p = _d_malloc((maxsize + 1) * sizeof(size_t));
+  for (size_t o = 0; o < nb; o++) {
+    size_t b = order[o], *k = &keys[start[b]], s = size[b];
+    disp[b] = 0;
+    if (s == 0) continue;
+    for (uint64_t d = 0; ; d++) {
+      if (d > UINT32_MAX) die("xfreeze: cannot place bucket of %zu keys", s);
+      size_t i, j;
+      for (i = 0; i < s; i++) {
+        p[i] = _d_mphpos(hv[k[i]], d, m);
+        if (taken[p[i]]) break;
+        for (j = 0; (j < i) && (p[j] != p[i]); j++);
+        if (j < i) break;
+      }
+      if (i < s) continue;
+      disp[b] = d;
+      break;
+    }
+    for (size_t i = 0; i < s; i++) {
+      taken[p[i]] = 1;
+      pos[k[i]] = p[i];
+    }
+  }
+  _d_free(p); _d_free(taken); _d_free(bysize); _d_free(size);
+  _d_free(next); _d_free(keys); _d_free(start);
+}
+
+/*** saving and mapping arrays */
+
+/* A saved array starts with a header (_d_fhead_t, see dlib.h)
+   followed by nbytes of raw data.  If its first nelem elements have a
+   string key at byte offset koff, the data is followed by a blob of
+   blob bytes with the key strings, and each saved key holds 1 + the
+   offset of its string in the blob (or 0 for NULL).  The data starts
+   at a 64 byte boundary of the mapping, so it is aligned for any
+   element type. */
+
+#define _D_MAGIC 0x3152524142494C44ULL /* "DLIBARR1" */
+
+/* A file may hold several saved arrays (e.g. the symbol table), each
+   starting at a multiple of _D_PAGE so that it can be mapped on its
+   own.  _d_fsave writes one at the current position of f and returns
+   false on error; _d_fmmap maps the one at the current position and
+   moves past it.  The mapping is shared and read-only, and string
+   keys stay offsets (see _d_mblob), unless priv: then it is a private
+   copy that can be modified and the keys are turned into pointers. */
+
+#define _D_PAGE 65536
+
+static bool _d_fsave(FILE *f, darr_t a, size_t esize, size_t nelem, size_t nbytes, size_t koff) {
+  if (len(a) == 0) nelem = nbytes = 0;
+  _d_fhead_t h = { _D_MAGIC, esize, a->bits, nelem, nbytes, koff, 0, 0 };
+  char *d = a->data;
+  if (koff != _D_NOKEY) {
+    for (size_t i = 0; i < nelem; i++) {
+      str_t k = *(str_t *) (d + i * esize + koff);
+      if (k != NULL) h.blob += strlen(k) + 1;
+    }
+  }
+  bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+  if (koff == _D_NOKEY) {
+    ok = ok && (fwrite(d, 1, nbytes, f) == nbytes);
+  } else {
+    char *e = _d_malloc(esize);
+    str_t *k = (str_t *) (e + koff);
+    size_t off = 1;
+    for (size_t i = 0; ok && (i < nelem); i++) {
+      memcpy(e, d + i * esize, esize);
+      if (*k != NULL) {
+	size_t l = strlen(*k) + 1;
+	*k = (str_t) (uintptr_t) off;
+	off += l;
+      }
+      ok = (fwrite(e, esize, 1, f) == 1);
+    }
+    _d_free(e);
+    size_t rest = nbytes - nelem * esize;
+    ok = ok && (fwrite(d + nelem * esize, 1, rest, f) == rest);
+    for (size_t i = 0; ok && (i < nelem); i++) {
+      str_t s = *(str_t *) (d + i * esize + koff);
+      if (s != NULL) ok = (fwrite(s, strlen(s) + 1, 1, f) == 1);
+    }
+  }
+  return ok;
+}
+
+static bool _d_fpad(FILE *f) {
+  long pos = ftell(f);
+  if (pos < 0) return false;
+  for (; pos % _D_PAGE; pos++) if (fputc(0, f) == EOF) return false;
+  return true;
+}
+
+void _d_save(darr_t a, size_t esize, size_t nelem, size_t nbytes, size_t koff, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) die("Cannot open %s", path);
+  bool ok = _d_fsave(f, a, esize, nelem, nbytes, koff);
+  if (fclose(f) || !ok) die("Cannot write %s", path);
+}
+
+static darr_t _d_fmmap(FILE *f, size_t esize, const char *path, bool priv) {
+  long pos = ftell(f);
+  _d_fhead_t h;
+  if ((fread(&h, sizeof(h), 1, f) != 1) || (h.magic != _D_MAGIC))
+    die("%s is not a saved darr_t", path);
+  if (h.esize != esize)
+    die("%s has elements of size %zu, expected %zu", path, (size_t) h.esize, esize);
+  struct stat st;
+  if ((pos < 0) || fstat(fileno(f), &st))
+    die("Cannot stat %s", path);
+  uint64_t avail = (uint64_t) st.st_size - (uint64_t) pos - sizeof(h);
+  if (((uint64_t) st.st_size < (uint64_t) pos + sizeof(h)) ||
+      (h.nbytes > avail) || (h.blob > avail - h.nbytes) ||
+      (h.nelem * h.esize > h.nbytes))
+    die("%s is truncated or corrupt", path);
+  size_t size = sizeof(h) + h.nbytes + h.blob;
+  char *m;
+#ifdef _NO_MMAP
+  m = _d_malloc(size);
+  memcpy(m, &h, sizeof(h));
+  if (fread(m + sizeof(h), 1, size - sizeof(h), f) != size - sizeof(h))
+    die("Cannot read %s", path);
+#else
+  m = mmap(NULL, size, (priv ? (PROT_READ | PROT_WRITE) : PROT_READ),
+	   (priv ? MAP_PRIVATE : MAP_SHARED), fileno(f), pos);
+  if (m == MAP_FAILED) die("Cannot mmap %s", path);
+#endif
+  fseek(f, (pos + size + _D_PAGE - 1) / _D_PAGE * _D_PAGE, SEEK_SET);
+  char *d = m + sizeof(h);
+  if (priv && (h.koff != _D_NOKEY)) {
+    char *blob = d + h.nbytes - 1;
+    for (size_t i = 0; i < h.nelem; i++) {
+      str_t *k = (str_t *) (d + i * esize + h.koff);
+      if (*k != NULL) *k = blob + (uintptr_t) *k;
+    }
+  }
+  darr_t a = _d_malloc(sizeof(struct darr_s));
+  a->data = d;
+  a->bits = h.bits;
+  return a;
+}
+
+darr_t _d_mmap(const char *path, size_t esize) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) die("Cannot open %s", path);
+  darr_t a = _d_fmmap(f, esize, path, false);
+  fclose(f);
+  return a;
+}
+
+void darr_unmap(darr_t a) {
+  _d_fhead_t *h = (_d_fhead_t *) (((char *) a->data) - sizeof(_d_fhead_t));
+#ifdef _NO_MMAP
+  _d_free(h);
+#else
+  munmap(h, sizeof(*h) + h->nbytes + h->blob);
+#endif
+  _d_free(a);
+}
+
 /*** fast memory allocation */
 
 #define _D_MSIZE (1<<20)
@@ -316,48 +748,1156 @@ ptr_t _dalloc_helper(size_t size) {
 
 /*** symbol table */
 
-static darr_t _d_strtable;
-static darr_t _d_symtable;
+/* A symtab_t numbers strings 1, 2, 3, ... in the order they are
+   created.  The string of symbol u is kept in chunk k = log2(u) at
+   offset u - 2^k.  Chunks never move, so sym2str needs no lock.
+
+   Strings are hashed with D_SYMHASH into _D_SYMSHARDS shards, each an
+   open addressing table with its own lock and string arena.  A slot
+   holds a symbol and the low 32 bits of its hash: probes compare the
+   strings only if the hashes match, and a resize places the symbols
+   without hashing their strings again (the index of a slot is taken
+   from the same 32 bits, so a shard holds at most 2^32 slots).
+   Lookups do not lock: a slot is written once, with a release store
+   after the string of its symbol, and a resize publishes a new slot
+   array but keeps the old one (until symtab_free) for readers that
+   may still be probing it.  An insert locks its shard, probes again,
+   and copies the string into the shard's arena, whose blocks double
+   in size up to _D_SYMBLOCK.
+
+   A frozen symtab_t keeps its symbols in a minimal perfect hash (see
+   xfreeze) instead of the shards.  A loaded symtab_t points its first
+   chunks (nmapped) and its slot arrays into the mapped file. */
+
+#define _D_SYMSHARDS 64
+#define _D_SYMCHUNKS 32
+#define _D_SYMBLOCK (1<<16)
+
+typedef uint64_t _d_symslot_t;
+#define _d_mkslot(u, hv) ((((uint64_t) (uint32_t) (hv)) << 32) | (u))
+#define _d_slotsym(x) ((sym_t) (x))
+#define _d_slothash(x) ((uint32_t) ((x) >> 32))
+
+typedef struct _d_symslots_s {
+  _d_symslot_t *s;
+  size_t mask;
+  bool mapped;
+  struct _d_symslots_s *old;
+} _d_symslots_t;
 
-#define _d_sym2str(u) (((str_t *)(_d_strtable->data))[u-1])
-#define _d_iszero(u) ((u)==0)
-#define _d_mkzero(u) ((u)=0)
+typedef struct _d_symblock_s { struct _d_symblock_s *next; } _d_symblock_t;
 
-static sym_t _d_syminit(const str_t s) {
-  if (_d_strtable == NULL) _d_strtable = darr(0, str_t);
-  size_t l = len(_d_strtable);
-  val(_d_strtable, l, str_t) = dstrdup(s);
-  return l+1;
+typedef struct _d_symshard_s {
+  _d_symslots_t *t;
+  size_t len;
+  char *arena;
+  size_t left, bsize;
+  _d_symblock_t *blocks;
+#ifndef _NO_PTHREAD
+  pthread_mutex_t lock;
+#endif
+} _d_symshard_t;
+
+struct symtab_s {
+  str_t *chunk[_D_SYMCHUNKS];
+  size_t nsym;
+  size_t nmapped;
+  darr_t frozen;
+  darr_t strmap, symmap;
+  struct _d_symcomp_s *comp;
+  dbloom_t bloom;
+  _d_symshard_t shard[_D_SYMSHARDS];
+};
+
+#ifndef D_SYMHASH
+#define D_SYMHASH strhash
+#endif
+
+#define _d_symshard(t, hv) (&((t)->shard[((hv) >> 32) & (_D_SYMSHARDS - 1)]))
+
+#ifdef _NO_PTHREAD
+#define _d_symlock(sh) ((void)(sh))
+#define _d_symunlock(sh) ((void)(sh))
+#else
+#define _d_symlock(sh) pthread_mutex_lock(&((sh)->lock))
+#define _d_symunlock(sh) pthread_mutex_unlock(&((sh)->lock))
+#endif
+
+static inline unsigned _d_symchunk(sym_t u) {
+#ifdef __GNUC__
+  return 31 - __builtin_clz(u);
+#else
+  unsigned k = 0;
+  while (u >>= 1) k++;
+  return k;
+#endif
 }
 
-D_HASH(_d_sym, sym_t, str_t, _d_sym2str, d_strmatch, fnv1a, _d_syminit, _d_iszero, _d_mkzero)
+#define _d_symstr(t, u) (_d_load(&(t)->chunk[_d_symchunk(u)])[(u) - (1ULL << _d_symchunk(u))])
 
-sym_t str2sym(const str_t str, bool insert) {
-  if (_d_symtable == NULL) _d_symtable = darr(0, sym_t);
-  sym_t *p = _d_symget(_d_symtable, str, insert);
-  return ((p == NULL) ? 0 : (*p));
+static _d_symslots_t *_d_symslots(size_t c) {
+  _d_symslots_t *s = _d_malloc(sizeof(_d_symslots_t));
+  s->s = _d_calloc(c, sizeof(_d_symslot_t));
+  s->mask = c - 1;
+  s->mapped = false;
+  s->old = NULL;
+  return s;
 }
 
-str_t sym2str(sym_t sym) {
-  if ((sym == 0) || (_d_strtable == NULL) || (len(_d_strtable) < sym)) {
-    return NULL;
-  } else {
-    return (((str_t *)(_d_strtable->data))[sym - 1]);
+static void _d_symslots_free(_d_symslots_t *s) {
+  while (s != NULL) {
+    _d_symslots_t *o = s->old;
+    if (!s->mapped) _d_free(s->s);
+    _d_free(s);
+    s = o;
+  }
+}
+
+static inline void _d_symput(_d_symslots_t *s, _d_symslot_t x) {
+  size_t i = _d_slothash(x) & s->mask, step = 0;
+  while (s->s[i] != 0) i = (i + (++step)) & s->mask;
+  s->s[i] = x;
+}
+
+/* Return the slot with the symbol of str, or the empty slot where it
+   should be inserted. */
+
+static inline _d_symslot_t *_d_symprobe(symtab_t t, _d_symslots_t *s, const str_t str, size_t hv) {
+  uint32_t h = (uint32_t) hv;
+  size_t i = h & s->mask, step = 0;
+  for (;;) {
+    _d_symslot_t x = _d_load(&s->s[i]);
+    if ((x == 0) || ((_d_slothash(x) == h) && !strcmp(_d_symstr(t, _d_slotsym(x)), str)))
+      return &s->s[i];
+    i = (i + (++step)) & s->mask;
+  }
+}
+
+static _d_symslots_t *_d_symgrow(_d_symshard_t *sh) {
+  _d_symslots_t *o = sh->t, *n = _d_symslots(2 * (o->mask + 1));
+  for (size_t i = 0; i <= o->mask; i++) {
+    if (o->s[i] != 0) _d_symput(n, o->s[i]);
+  }
+  n->old = o;
+  _d_store(&sh->t, n);
+  return n;
+}
+
+static sym_t _d_symnew(symtab_t t, _d_symshard_t *sh, const str_t str) {
+  size_t l = strlen(str) + 1;
+  if (l > sh->left) {
+    if (sh->bsize < _D_SYMBLOCK) sh->bsize = (sh->bsize ? 2 * sh->bsize : 1024);
+    size_t n = (l > sh->bsize ? l : sh->bsize);
+    _d_symblock_t *b = _d_malloc(sizeof(_d_symblock_t) + n);
+    b->next = sh->blocks;
+    sh->blocks = b;
+    sh->arena = (char *) (b + 1);
+    sh->left = n;
+  }
+  char *s = sh->arena;
+  memcpy(s, str, l);
+  sh->arena += l;
+  sh->left -= l;
+  size_t u = _d_xadd(&t->nsym, 1) + 1;
+  if (u > UINT32_MAX) die("symtab_t cannot hold more than %u symbols", UINT32_MAX);
+  unsigned k = _d_symchunk(u);
+  str_t *c = _d_load(&t->chunk[k]);
+  if (c == NULL) {
+    str_t *n = _d_calloc(1ULL << k, sizeof(str_t));
+    if (_d_cas(&t->chunk[k], NULL, n)) c = n;
+    else { _d_free(n); c = _d_load(&t->chunk[k]); }
+  }
+  _d_store(&c[u - (1ULL << k)], s);
+  return u;
+}
+
+/* Build the shard tables for symbols 1..nsym, e.g. after a thaw. */
+
+static void _d_symfill(symtab_t t) {
+  size_t n = t->nsym;
+  size_t *hv = _d_malloc(n * sizeof(size_t) + 1);
+  size_t cnt[_D_SYMSHARDS] = { 0 };
+  for (sym_t u = 1; u <= n; u++) {
+    hv[u-1] = D_SYMHASH(_d_symstr(t, u));
+    cnt[_d_symshard(t, hv[u-1]) - t->shard]++;
+  }
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    _d_symslots_free(t->shard[i].t);
+    t->shard[i].t = _d_symslots(1ULL << _d_hbits(cnt[i], D_HLOAD));
+    t->shard[i].len = cnt[i];
+  }
+  for (sym_t u = 1; u <= n; u++) _d_symput(_d_symshard(t, hv[u-1])->t, _d_mkslot(u, hv[u-1]));
+  _d_free(hv);
+}
+
+static void _d_symthaw(symtab_t t) {
+  darr_free(t->frozen);
+  t->frozen = NULL;
+  _d_symfill(t);
+}
+
+/* _d_symmove replaces the contents of t with those of r (but keeps
+   the locks and the Bloom filter of t) and frees r with the old
+   contents of t.  The callers move the same symbols or a subset of
+   them, so the filter still has no false negatives. */
+
+#ifdef _NO_PTHREAD
+#define _D_SHARDDATA sizeof(_d_symshard_t)
+#else
+#define _D_SHARDDATA offsetof(_d_symshard_t, lock)
+#endif
+
+static void _d_memswap(void *a, void *b, size_t n) {
+  char *x = a, *y = b;
+  for (size_t i = 0; i < n; i++) { char c = x[i]; x[i] = y[i]; y[i] = c; }
+}
+
+static void _d_symmove(symtab_t t, symtab_t r) {
+  // The shards come last in symtab_s and their locks last in _d_symshard_t.
+  _d_memswap(t, r, offsetof(struct symtab_s, shard));
+  for (size_t i = 0; i < _D_SYMSHARDS; i++)
+    _d_memswap(&t->shard[i], &r->shard[i], _D_SHARDDATA);
+  dbloom_t b = t->bloom;
+  t->bloom = r->bloom;
+  r->bloom = b;
+  symtab_free(r);
+}
+
+/* A compressed symtab_t keeps its strings sorted and front coded in
+   blocks of _D_SYMFRONT: the first string of a block is stored as is,
+   each of the others as the length of the prefix it shares with the
+   previous string (a varint) followed by the rest of the string.
+   rank[u-1] is the position of symbol u in sorted order and sym[r]
+   the symbol at position r.  sym2str decodes the whole block of the
+   symbol into dec[b] the first time it is needed and keeps it until
+   the table is expanded or freed, so the strings it returns stay
+   valid.  str2sym finds the block by binary search on the first
+   strings and compares str with its strings without decoding them. */
+
+#define _D_SYMFRONT 16
+
+typedef struct _d_symcomp_s {
+  size_t n, nb;
+  uint8_t *data;
+  size_t *block;
+  uint32_t *rank;
+  sym_t *sym;
+  char **dec;
+} _d_symcomp_t;
+
+static inline size_t _d_getvar(const uint8_t **p) {
+  size_t x = 0;
+  for (unsigned sh = 0; ; sh += 7) {
+    uint8_t b = *(*p)++;
+    x |= ((size_t) (b & 127)) << sh;
+    if (b < 128) return x;
+  }
+}
+
+static inline size_t _d_putvar(uint8_t *p, size_t x) {
+  size_t n = 0;
+  for (; x >= 128; x >>= 7) {
+    if (p != NULL) p[n] = (uint8_t) (x | 128);
+    n++;
+  }
+  if (p != NULL) p[n] = (uint8_t) x;
+  return n + 1;
+}
+
+/* Decode the strings of block b one after another into a new buffer
+   that is just large enough: each string follows the NUL of the one
+   before it. */
+
+static char *_d_symdecode(_d_symcomp_t *c, size_t b) {
+  size_t beg = b * _D_SYMFRONT, end = beg + _D_SYMFRONT, size = 0;
+  if (end > c->n) end = c->n;
+  const uint8_t *p = c->data + c->block[b];
+  for (size_t i = beg; i < end; i++) {
+    size_t l = (i == beg) ? 0 : _d_getvar(&p);
+    size_t m = strlen((const char *) p) + 1;
+    size += l + m;
+    p += m;
   }
+  char *buf = _d_malloc(size), *q = buf, *prev = NULL;
+  p = c->data + c->block[b];
+  for (size_t i = beg; i < end; i++) {
+    size_t l = (i == beg) ? 0 : _d_getvar(&p);
+    size_t m = strlen((const char *) p) + 1;
+    if (l > 0) memcpy(q, prev, l);
+    memcpy(q + l, p, m);
+    p += m;
+    prev = q;
+    q += l + m;
+  }
+  return buf;
+}
+
+static str_t _d_symcstr(_d_symcomp_t *c, sym_t u) {
+  size_t r = c->rank[u-1], b = r / _D_SYMFRONT;
+  char *d = _d_load(&c->dec[b]);
+  if (d == NULL) {
+    char *n = _d_symdecode(c, b);
+    if (_d_cas(&c->dec[b], NULL, n)) d = n;
+    else { _d_free(n); d = _d_load(&c->dec[b]); }
+  }
+  for (size_t i = r % _D_SYMFRONT; i > 0; i--) d += strlen(d) + 1;
+  return d;
+}
+
+/* k is the length of the prefix str shares with the previous string.
+   A string that shares more than k characters with the previous one
+   differs from str at k; otherwise only its stored rest has to be
+   compared with str. */
+
+static sym_t _d_symcget(_d_symcomp_t *c, const str_t str) {
+  size_t lo = 0, hi = c->nb;
+  if (c->n == 0) return 0;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp((const char *) (c->data + c->block[mid]), str) <= 0) lo = mid;
+    else hi = mid;
+  }
+  const uint8_t *p = c->data + c->block[lo];
+  size_t beg = lo * _D_SYMFRONT, end = beg + _D_SYMFRONT, k = 0;
+  if (end > c->n) end = c->n;
+  for (size_t i = beg; i < end; i++) {
+    size_t l = (i == beg) ? 0 : _d_getvar(&p);
+    const char *s = (const char *) p;
+    p += strlen(s) + 1;
+    if (l > k) continue;
+    size_t j = 0;
+    while ((s[j] != 0) && (s[j] == str[l + j])) j++;
+    if ((s[j] == 0) && (str[l + j] == 0)) return c->sym[i];
+    k = l + j;
+  }
+  return 0;
+}
+
+static void _d_symcfree(_d_symcomp_t *c) {
+  for (size_t b = 0; b < c->nb; b++) _d_free(c->dec[b]);
+  _d_free(c->data); _d_free(c->block);
+  _d_free(c->rank); _d_free(c->sym);
+  _d_free(c->dec);
+  _d_free(c);
+}
+
+typedef struct { str_t s; sym_t u; } _d_symstr_t;
+
+static int _d_symstrcmp(const void *a, const void *b) {
+  return strcmp(((const _d_symstr_t *) a)->s, ((const _d_symstr_t *) b)->s);
+}
+
+static void _d_symexpand(symtab_t t) {
+  _d_symcomp_t *c = t->comp;
+  symtab_t r = symtab_new();
+  for (sym_t u = 1; u <= c->n; u++)
+    if (symtab_str2sym(r, _d_symcstr(c, u), true) != u)
+      die("symtab_t: cannot expand compressed symbol %u", u);
+  _d_symmove(t, r);
+}
+
+void symtab_compress(symtab_t t) {
+  if (t->comp != NULL) return;
+  size_t n = t->nsym, size = 0;
+  _d_symcomp_t *c = _d_calloc(1, sizeof(_d_symcomp_t));
+  _d_symstr_t *a = _d_malloc((n + 1) * sizeof(_d_symstr_t));
+  for (sym_t u = 1; u <= n; u++) a[u-1] = (_d_symstr_t) { _d_symstr(t, u), u };
+  qsort(a, n, sizeof(_d_symstr_t), _d_symstrcmp);
+  c->n = n;
+  c->nb = (n + _D_SYMFRONT - 1) / _D_SYMFRONT;
+  c->block = _d_malloc((c->nb + 1) * sizeof(size_t));
+  c->rank = _d_malloc((n + 1) * sizeof(uint32_t));
+  c->sym = _d_malloc((n + 1) * sizeof(sym_t));
+  c->dec = _d_calloc(c->nb + 1, sizeof(char *));
+  for (int pass = 0; pass < 2; pass++) {
+    uint8_t *p = (pass ? (c->data = _d_malloc(size + 1)) : NULL);
+    size = 0;
+    for (size_t i = 0; i < n; i++) {
+      size_t l = 0, m = strlen(a[i].s);
+      if (i % _D_SYMFRONT == 0) {
+	if (pass) c->block[i / _D_SYMFRONT] = size;
+      } else {
+	while ((a[i].s[l] != 0) && (a[i].s[l] == a[i-1].s[l])) l++;
+	size += _d_putvar(pass ? p + size : NULL, l);
+      }
+      if (pass) memcpy(p + size, a[i].s + l, m - l + 1);
+      size += m - l + 1;
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    c->rank[a[i].u - 1] = i;
+    c->sym[i] = a[i].u;
+  }
+  _d_free(a);
+  symtab_t r = symtab_new();
+  _d_symmove(t, r);
+  t->nsym = n;
+  t->comp = c;
+}
+
+symtab_t symtab_new() {
+  symtab_t t = _d_calloc(1, sizeof(struct symtab_s));
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    t->shard[i].t = _d_symslots(16);
+#ifndef _NO_PTHREAD
+    if (pthread_mutex_init(&t->shard[i].lock, NULL))
+      die("Cannot initialize symtab_t lock");
+#endif
+  }
+  return t;
+}
+
+void symtab_free(symtab_t t) {
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    _d_symshard_t *sh = &t->shard[i];
+    _d_symslots_free(sh->t);
+    while (sh->blocks != NULL) {
+      _d_symblock_t *b = sh->blocks->next;
+      _d_free(sh->blocks);
+      sh->blocks = b;
+    }
+#ifndef _NO_PTHREAD
+    pthread_mutex_destroy(&sh->lock);
+#endif
+  }
+  for (size_t k = t->nmapped; k < _D_SYMCHUNKS; k++)
+    if (t->chunk[k] != NULL) _d_free(t->chunk[k]);
+  if (t->frozen != NULL) darr_free(t->frozen);
+  if (t->bloom != NULL) bloom_free(t->bloom);
+  if (t->strmap != NULL) darr_unmap(t->strmap);
+  if (t->symmap != NULL) darr_unmap(t->symmap);
+  if (t->comp != NULL) _d_symcfree(t->comp);
+  _d_free(t);
+}
+
+size_t symtab_len(symtab_t t) {
+  return _d_load(&t->nsym);
+}
+
+str_t symtab_sym2str(symtab_t t, sym_t u) {
+  if ((u == 0) || (u > _d_load(&t->nsym))) return NULL;
+  if (t->comp != NULL) return _d_symcstr(t->comp, u);
+  /* u was counted in nsym by the _d_symnew call that creates it
+     before it stored its string, so wait for the string. */
+  unsigned k = _d_symchunk(u);
+  str_t *c, s;
+  while ((c = _d_load(&t->chunk[k])) == NULL);
+  while ((s = _d_load(&c[u - (1ULL << k)])) == NULL);
+  return s;
+}
+
+static inline sym_t _d_symfget(symtab_t t, const str_t str, size_t hv) {
+  darr_t f = t->frozen;
+  size_t n = len(f);
+  if (n == 0) return 0;
+  uint32_t *disp = _d_mphdisp(f, sizeof(sym_t));
+  size_t m = n - disp[cap(f)];
+  sym_t *e = (sym_t *) (f->data);
+  size_t i = _d_mphpos(hv, disp[_d_mphbucket(hv, cap(f))], m);
+  if (!strcmp(_d_symstr(t, e[i]), str)) return e[i];
+  for (i = m; (i < n) && strcmp(_d_symstr(t, e[i]), str); i++);
+  return (i < n) ? e[i] : 0;
+}
+
+/* New symbols are added to the filter of the table with atomic ors,
+   since symbols in different shards are created concurrently. */
+
+static void _d_symbloomadd(dbloom_t b, uint64_t hv) {
+  uint64_t x, *w = _d_bloomblk(b, hv, &x);
+  for (int i = 0; i < 8; i++) _d_or(&w[i], 1ULL << ((x >> (6 * i)) & 63));
+}
+
+void symtab_bloom(symtab_t t) {
+  if (t->bloom != NULL) bloom_free(t->bloom);
+  dbloom_t b = bloom_new(t->nsym);
+  for (sym_t u = 1; u <= t->nsym; u++) bloom_add(b, D_SYMHASH(symtab_sym2str(t, u)));
+  t->bloom = b;
+}
+
+sym_t symtab_str2sym(symtab_t t, const str_t str, bool create) {
+  size_t hv = D_SYMHASH(str);
+  if (!create && (t->bloom != NULL) && !bloom_has(t->bloom, hv)) return 0;
+  if (t->comp != NULL) {
+    sym_t u = _d_symcget(t->comp, str);
+    if ((u != 0) || !create) return u;
+    _d_symexpand(t);
+  }
+  if (t->frozen != NULL) {
+    sym_t u = _d_symfget(t, str, hv);
+    if ((u != 0) || !create) return u;
+    _d_symthaw(t);
+  }
+  _d_symshard_t *sh = _d_symshard(t, hv);
+  sym_t u = _d_slotsym(_d_load(_d_symprobe(t, _d_load(&sh->t), str, hv)));
+  if ((u != 0) || !create) return u;
+  _d_symlock(sh);
+  _d_symslots_t *s = sh->t;
+  _d_symslot_t *p = _d_symprobe(t, s, str, hv);
+  if ((u = _d_slotsym(*p)) == 0) {
+    if (sh->len >= _d_hmax(s->mask + 1, D_HLOAD)) {
+      s = _d_symgrow(sh);
+      p = _d_symprobe(t, s, str, hv);
+    }
+    u = _d_symnew(t, sh, str);
+    if (t->bloom != NULL) _d_symbloomadd(t->bloom, hv);
+    _d_store(p, _d_mkslot(u, hv));
+    sh->len++;
+  }
+  _d_symunlock(sh);
+  return u;
+}
+
+void symtab_freeze(symtab_t t) {
+  if ((t->frozen != NULL) || (t->comp != NULL)) return;
+  size_t n = t->nsym;
+  darr_t f = _d_malloc(sizeof(struct darr_s));
+  f->bits = n;
+  _d_setcapbits(f, _d_mphbits(n));
+  f->data = _d_malloc(_D_ALIGN(n * sizeof(sym_t)) + (cap(f) + 1) * sizeof(uint32_t));
+  size_t *hv = _d_calloc(n, sizeof(size_t));
+  size_t *pos = _d_malloc(n * sizeof(size_t));
+  for (sym_t u = 1; u <= n; u++) hv[u-1] = D_SYMHASH(_d_symstr(t, u));
+  _d_mph(hv, n, cap(f), _d_mphdisp(f, sizeof(sym_t)), pos);
+  for (sym_t u = 1; u <= n; u++) ((sym_t *) (f->data))[pos[u-1]] = u;
+  _d_free(pos);
+  _d_free(hv);
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    _d_symslots_free(t->shard[i].t);
+    t->shard[i].t = _d_symslots(16);
+    t->shard[i].len = 0;
+  }
+  t->frozen = f;
+}
+
+/* A saved symtab_t has three sections: the number of shards followed
+   by the capacity of each shard, the strings of the symbols (see
+   _d_fsave), and the slot arrays of the shards one after another. */
+
+void symtab_save(symtab_t t, const char *path) {
+  if (t->comp != NULL) _d_symexpand(t);
+  if (t->frozen != NULL) _d_symthaw(t);
+  size_t n = t->nsym;
+  darr_t meta = darr(_D_SYMSHARDS + 1, uint64_t);
+  darr_t strs = darr(n, str_t);
+  val(meta, 0, uint64_t) = _D_SYMSHARDS;
+  size_t nslots = 0;
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    val(meta, i + 1, uint64_t) = t->shard[i].t->mask + 1;
+    nslots += t->shard[i].t->mask + 1;
+  }
+  for (sym_t u = 1; u <= n; u++) val(strs, u - 1, str_t) = _d_symstr(t, u);
+  darr_t slots = darr(nslots, _d_symslot_t);
+  _d_setlen(slots, nslots);
+  for (size_t i = 0, j = 0; i < _D_SYMSHARDS; i++) {
+    _d_symslots_t *s = t->shard[i].t;
+    memcpy(((_d_symslot_t *) (slots->data)) + j, s->s, (s->mask + 1) * sizeof(_d_symslot_t));
+    j += s->mask + 1;
+  }
+  FILE *f = fopen(path, "w");
+  if (f == NULL) die("Cannot open %s", path);
+  bool ok = (_d_fsave(f, meta, sizeof(uint64_t), len(meta), len(meta) * sizeof(uint64_t), _D_NOKEY) &&
+	     _d_fpad(f) &&
+	     _d_fsave(f, strs, sizeof(str_t), n, n * sizeof(str_t), 0) &&
+	     _d_fpad(f) &&
+	     _d_fsave(f, slots, sizeof(_d_symslot_t), nslots, nslots * sizeof(_d_symslot_t), _D_NOKEY));
+  if (fclose(f) || !ok) die("Cannot write %s", path);
+  darr_free(slots);
+  darr_free(strs);
+  darr_free(meta);
+}
+
+symtab_t symtab_load(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) die("Cannot open %s", path);
+  darr_t meta = _d_fmmap(f, sizeof(uint64_t), path, false);
+  if ((len(meta) != _D_SYMSHARDS + 1) || (val(meta, 0, uint64_t) != _D_SYMSHARDS))
+    die("%s: symbol table has a different number of shards", path);
+  symtab_t t = symtab_new();
+  str_t *s = (t->strmap = _d_fmmap(f, sizeof(str_t), path, true))->data;
+  _d_symslot_t *y = (t->symmap = _d_fmmap(f, sizeof(_d_symslot_t), path, true))->data;
+  fclose(f);
+  size_t n = t->nsym = len(t->strmap);
+  for (unsigned k = 0; (1ULL << k) <= n; k++) {
+    if ((2ULL << k) - 1 <= n) {
+      t->chunk[k] = s + (1ULL << k) - 1;
+      t->nmapped = k + 1;
+    } else {
+      t->chunk[k] = _d_calloc(1ULL << k, sizeof(str_t));
+      memcpy(t->chunk[k], s + (1ULL << k) - 1, (n - (1ULL << k) + 1) * sizeof(str_t));
+    }
+  }
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    _d_symshard_t *sh = &t->shard[i];
+    _d_symslots_free(sh->t);
+    sh->t = _d_malloc(sizeof(_d_symslots_t));
+    sh->t->s = y;
+    sh->t->mask = val(meta, i + 1, uint64_t) - 1;
+    sh->t->mapped = true;
+    sh->t->old = NULL;
+    for (size_t j = 0; j <= sh->t->mask; j++) sh->len += (y[j] != 0);
+    y += sh->t->mask + 1;
+  }
+  darr_unmap(meta);
+  return t;
+}
+
+/* symtab_renumber builds a new table by creating the kept symbols in
+   their new order, so their strings also end up next to each other in
+   that order, and moves it into t. */
+
+
+typedef struct { size_t key; sym_t u; } _d_symkey_t;
+
+static int _d_symkeycmp(const void *a, const void *b) {
+  const _d_symkey_t *x = a, *y = b;
+  if (x->key != y->key) return ((x->key > y->key) ? -1 : 1);
+  return ((x->u < y->u) ? -1 : (x->u > y->u));
+}
+
+darr_t symtab_renumber(symtab_t t, darr_t keys, bool drop) {
+  if (t->comp != NULL) _d_symexpand(t);
+  size_t n = t->nsym, m = 0;
+  if (len(keys) < n + 1)
+    die("symtab_renumber: %zu keys for %zu symbols, expected %zu", (size_t) len(keys), n, n + 1);
+  const size_t *key = keys->data;
+  _d_symkey_t *k = _d_malloc((n + 1) * sizeof(_d_symkey_t));
+  for (sym_t u = 1; u <= n; u++) {
+    if (drop && (key[u] == 0)) continue;
+    k[m++] = (_d_symkey_t) { key[u], u };
+  }
+  qsort(k, m, sizeof(_d_symkey_t), _d_symkeycmp);
+  darr_t map = darr(n + 1, sym_t);
+  _d_setlen(map, n + 1);
+  memset(map->data, 0, (n + 1) * sizeof(sym_t));
+  symtab_t r = symtab_new();
+  for (size_t i = 0; i < m; i++)
+    val(map, k[i].u, sym_t) = symtab_str2sym(r, _d_symstr(t, k[i].u), true);
+  _d_free(k);
+  _d_symmove(t, r);
+  return map;
+}
+
+void sym_remap(sym_t *a, size_t n, darr_t map) {
+  sym_t *m = map->data;
+  size_t l = len(map);
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] >= l) die("sym_remap: symbol %u is not in the map", a[i]);
+    a[i] = m[a[i]];
+  }
+}
+
+/* The global functions use a default symtab_t created on first use. */
+
+static symtab_t _d_symtab;
+
+static symtab_t _d_symdefault() {
+  symtab_t t = _d_load(&_d_symtab);
+  if (t == NULL) {
+    t = symtab_new();
+    if (!_d_cas(&_d_symtab, NULL, t)) {
+      symtab_free(t);
+      t = _d_load(&_d_symtab);
+    }
+  }
+  return t;
+}
+
+sym_t str2sym(const str_t str, bool create) {
+  return symtab_str2sym(_d_symdefault(), str, create);
+}
+
+str_t sym2str(sym_t sym) {
+  symtab_t t = _d_load(&_d_symtab);
+  return ((t == NULL) ? NULL : symtab_sym2str(t, sym));
 }
 
 void symtable_free() {
-  darr_free(_d_symtable); _d_symtable = NULL;
-  darr_free(_d_strtable); _d_strtable = NULL;
+  if (_d_symtab != NULL) symtab_free(_d_symtab);
+  _d_symtab = NULL;
+}
+
+void symtable_freeze() {
+  symtab_freeze(_d_symdefault());
+}
+
+void symtable_compress() {
+  symtab_compress(_d_symdefault());
+}
+
+void symtable_bloom() {
+  symtab_bloom(_d_symdefault());
+}
+
+void symtable_save(const char *path) {
+  symtab_save(_d_symdefault(), path);
+}
+
+darr_t symtable_renumber(darr_t keys, bool drop) {
+  return symtab_renumber(_d_symdefault(), keys, drop);
+}
+
+void symtable_load(const char *path) {
+  symtab_t t = symtab_load(path);
+  symtable_free();
+  _d_symtab = t;
 }
 
 void symdbg() {
+  symtab_t t = _d_symdefault();
+  size_t slots = 0, used = 0;
+  for (size_t i = 0; i < _D_SYMSHARDS; i++) {
+    slots += t->shard[i].t->mask + 1;
+    used += t->shard[i].len;
+  }
   msg("str_t=%lu", sizeof(str_t));
   msg("sym_t=%lu", sizeof(sym_t));
-  msg("strcap=%lu", _d_strtable == NULL ? 0 : cap(_d_strtable));
-  msg("strlen=%lu", _d_strtable == NULL ? 0 : len(_d_strtable));
-  msg("symcap=%lu", _d_symtable == NULL ? 0 : cap(_d_symtable));
-  msg("symlen=%lu", _d_symtable == NULL ? 0 : len(_d_symtable));
+  msg("nsym=%lu", t->nsym);
+  msg("symcap=%lu", slots);
+  msg("symlen=%lu", used);
+  msg("frozen=%lu", t->frozen == NULL ? 0 : len(t->frozen));
+}
+
+/*** symbol maps */
+
+void dsymmap_free(dsymmap_t m) {
+  _d_free(m->a.data); _d_free(m);
+}
+
+/*** n-gram counts */
+
+/* Move the non-empty elements of the table to the front of its
+   array and sort them by key.  An empty table may not have been
+   filled with empty elements yet (see xget). */
+
+static int _d_ngram2cmp(const void *p, const void *q) {
+  uint64_t a = ((const dngram2_t *) p)->key, b = ((const dngram2_t *) q)->key;
+  return (a > b) - (a < b);
+}
+
+static int _d_ngram4cmp(const void *p, const void *q) {
+  dkey4_t a = ((const dngram4_t *) p)->key, b = ((const dngram4_t *) q)->key;
+  if (a.hi != b.hi) return (a.hi > b.hi) - (a.hi < b.hi);
+  return (a.lo > b.lo) - (a.lo < b.lo);
+}
+
+void ngram2_sort(darr_t h) {
+  if (len(h) == 0) return;
+  dngram2_t *a = (dngram2_t *) (h->data);
+  size_t n = 0;
+  for (size_t i = 0, c = cap(h); i < c; i++)
+    if (a[i].key != 0) a[n++] = a[i];
+  qsort(a, n, sizeof(dngram2_t), _d_ngram2cmp);
+}
+
+void ngram4_sort(darr_t h) {
+  if (len(h) == 0) return;
+  dngram4_t *a = (dngram4_t *) (h->data);
+  size_t n = 0;
+  for (size_t i = 0, c = cap(h); i < c; i++)
+    if (a[i].key.hi != 0) a[n++] = a[i];
+  qsort(a, n, sizeof(dngram4_t), _d_ngram4cmp);
+}
+
+/*** counting tables */
+
+void dcount_free(dcount_t t) {
+  darr_free(t->over); _d_free(t->a.data); _d_free(t);
+}
+
+/*** approximate counts */
+
+/* The sketch has D_SKETCHDEPTH rows of 1 << wbits counters.  The
+   heavy hitters are a min-heap of at most k elements ordered by cnt,
+   and pos is a linear probing table on d_mix64(hv) that maps hv to 1
+   + its heap index (0 for an empty slot). */
+
+typedef struct { uint64_t hv; size_t i; } _d_skpos_t;
+
+struct dsketch_s {
+  uint32_t *cnt;
+  size_t wbits;
+  size_t (*hash)(const char *);
+  dheavy_t *heap;
+  size_t nheap, k;
+  _d_skpos_t *pos;
+  size_t pmask;
+};
+
+#define _d_skcell(s, r, hv) (((r) << (s)->wbits) + (d_mix64((hv) + ((uint64_t) (r) + 1) * 0x9E3779B97F4A7C15ULL) & ((1ULL << (s)->wbits) - 1)))
+
+dsketch_t sketch_new(size_t nbytes, size_t k, size_t (*hash)(const char *)) {
+  dsketch_t s = _d_calloc(1, sizeof(struct dsketch_s));
+  while ((D_SKETCHDEPTH * sizeof(uint32_t) << (s->wbits + 1)) <= nbytes) s->wbits++;
+  s->cnt = _d_calloc(D_SKETCHDEPTH << s->wbits, sizeof(uint32_t));
+  s->hash = (hash == NULL) ? strhash : hash;
+  s->k = k;
+  s->heap = _d_malloc((k + 1) * sizeof(dheavy_t));
+  size_t c = 1;
+  while (c < 2 * k) c <<= 1;
+  s->pos = _d_calloc(c, sizeof(_d_skpos_t));
+  s->pmask = c - 1;
+  return s;
+}
+
+void sketch_free(dsketch_t s) {
+  for (size_t i = 0; i < s->nheap; i++) _d_free(s->heap[i].key);
+  _d_free(s->heap); _d_free(s->pos); _d_free(s->cnt); _d_free(s);
+}
+
+static size_t _d_skest(dsketch_t s, uint64_t hv) {
+  size_t e = UINT32_MAX;
+  for (size_t r = 0; r < D_SKETCHDEPTH; r++) {
+    uint32_t c = s->cnt[_d_skcell(s, r, hv)];
+    if (c < e) e = c;
+  }
+  return e;
+}
+
+/* Conservative update: no counter needs to exceed the old estimate
+   plus n, so only the counters below that are raised. */
+
+static void _d_skupdate(dsketch_t s, uint64_t hv, size_t n) {
+  size_t e = _d_skest(s, hv) + n;
+  if (e > UINT32_MAX) e = UINT32_MAX;
+  for (size_t r = 0; r < D_SKETCHDEPTH; r++) {
+    uint32_t *c = &s->cnt[_d_skcell(s, r, hv)];
+    if (*c < e) *c = e;
+  }
+}
+
+static size_t _d_skfind(dsketch_t s, uint64_t hv) {
+  size_t i = d_mix64(hv) & s->pmask;
+  while ((s->pos[i].i != 0) && (s->pos[i].hv != hv))
+    i = (i + 1) & s->pmask;
+  return i;
+}
+
+static void _d_skdel(dsketch_t s, size_t j) {
+  size_t m = s->pmask;
+  for (size_t i = (j + 1) & m; s->pos[i].i != 0; i = (i + 1) & m) {
+    size_t h = d_mix64(s->pos[i].hv) & m;
+    if (((i - h) & m) >= ((i - j) & m)) {
+      s->pos[j] = s->pos[i];
+      j = i;
+    }
+  }
+  s->pos[j].i = 0;
+}
+
+static void _d_skput(dsketch_t s, size_t i, dheavy_t x) {
+  s->heap[i] = x;
+  s->pos[_d_skfind(s, x.hv)] = (_d_skpos_t) { x.hv, i + 1 };
+}
+
+static void _d_sksift(dsketch_t s, size_t i) {
+  dheavy_t *h = s->heap, x = h[i];
+  for (size_t c; (c = 2 * i + 1) < s->nheap; i = c) {
+    if ((c + 1 < s->nheap) && (h[c + 1].cnt < h[c].cnt)) c++;
+    if (x.cnt <= h[c].cnt) break;
+    _d_skput(s, i, h[c]);
+  }
+  _d_skput(s, i, x);
+}
+
+void sketch_addh(dsketch_t s, const char *key, uint64_t hv, size_t n) {
+  _d_skupdate(s, hv, n);
+  if (s->k == 0) return;
+  size_t j = _d_skfind(s, hv);
+  if (s->pos[j].i != 0) {
+    s->heap[s->pos[j].i - 1].cnt += n;
+    _d_sksift(s, s->pos[j].i - 1);
+  } else if (s->nheap < s->k) {
+    /* The table has not evicted any key yet, so this key is new. */
+    dheavy_t x = { _d_strdup(key), n, 0, hv };
+    size_t i = s->nheap++;
+    for (; (i > 0) && (s->heap[(i - 1) / 2].cnt > n); i = (i - 1) / 2)
+      _d_skput(s, i, s->heap[(i - 1) / 2]);
+    _d_skput(s, i, x);
+  } else {
+    /* Space-Saving: the new key replaces the one with the smallest
+       count m and gets the count m + n with an error of m. */
+    dheavy_t *h = &s->heap[0];
+    size_t m = h->cnt;
+    _d_skdel(s, _d_skfind(s, h->hv));
+    _d_free(h->key);
+    *h = (dheavy_t) { _d_strdup(key), m + n, m, hv };
+    _d_sksift(s, 0);
+  }
+}
+
+void sketch_add(dsketch_t s, const char *key, size_t n) {
+  sketch_addh(s, key, s->hash(key), n);
+}
+
+size_t sketch_get(dsketch_t s, const char *key) {
+  uint64_t hv = s->hash(key);
+  size_t e = _d_skest(s, hv);
+  if (s->k == 0) return e;
+  size_t j = _d_skfind(s, hv);
+  if ((s->pos[j].i != 0) && (s->heap[s->pos[j].i - 1].cnt < e)) e = s->heap[s->pos[j].i - 1].cnt;
+  return e;
+}
+
+static int _d_heavycmp(const void *p, const void *q) {
+  size_t a = ((const dheavy_t *) p)->cnt, b = ((const dheavy_t *) q)->cnt;
+  return (a < b) - (a > b);
+}
+
+darr_t sketch_top(dsketch_t s) {
+  darr_t a = darr(s->nheap, dheavy_t);
+  memcpy(a->data, s->heap, s->nheap * sizeof(dheavy_t));
+  _d_setlen(a, s->nheap);
+  qsort(a->data, s->nheap, sizeof(dheavy_t), _d_heavycmp);
+  return a;
+}
+
+/*** external counting */
+
+/* Runs are numbered files in the directory dir, and run[0..nrun-1]
+   are the ones that have not been merged yet.  nbytes counts the
+   bytes of the keys in the table. */
+
+typedef struct { char *key; size_t cnt; } _d_extelt_t;
+#define _d_extinit(k) ((_d_extelt_t) { _d_strdup(k), 0 })
+D_STRHASH(_d_exth, _d_extelt_t, _d_extinit)
+
+struct dextcnt_s {
+  darr_t h;
+  size_t nbytes, budget;
+  char *dir;
+  size_t *run, nrun, nextrun;
+};
+
+/* Runs are written and read with zlib (without a shell, so any tmpdir
+   works) unless _NO_ZLIB is defined. */
+
+#ifdef _NO_ZLIB
+#define _D_EXTSUFFIX ""
+typedef FILE *_d_extfile_t;
+#define _d_extfopen(path, w) fopen((path), (w) ? "w" : "r")
+#define _d_extfclose(f) fclose(f)
+#define _d_extfgets(buf, n, f) fgets((buf), (n), (f))
+#define _d_extfputs(str, f) (fputs((str), (f)) < 0)
+#else
+#define _D_EXTSUFFIX ".gz"
+typedef gzFile _d_extfile_t;
+#define _d_extfopen(path, w) gzopen((path), (w) ? "wb1" : "rb")
+#define _d_extfclose(f) gzclose(f)
+#define _d_extfgets(buf, n, f) gzgets((f), (buf), (n))
+#define _d_extfputs(str, f) (gzputs((f), (str)) < 0)
+#endif
+
+static char *_d_extpath(dextcnt_t c, size_t r) {
+  char *path = _d_malloc(strlen(c->dir) + 32);
+  sprintf(path, "%s/%zu" _D_EXTSUFFIX, c->dir, r);
+  return path;
+}
+
+static _d_extfile_t _d_extcreate(dextcnt_t c, size_t r) {
+  char *path = _d_extpath(c, r);
+  _d_extfile_t f = _d_extfopen(path, true);
+  if (f == NULL) die("Cannot create %s", path);
+  _d_free(path);
+  return f;
+}
+
+static void _d_extclose(_d_extfile_t f) {
+  if (_d_extfclose(f)) die("Cannot write run");
+}
+
+static void _d_extwrite(const char *key, size_t cnt, void *f) {
+  char buf[32];
+  sprintf(buf, "\t%zu\n", cnt);
+  if (_d_extfputs(key, (_d_extfile_t) f) || _d_extfputs(buf, (_d_extfile_t) f))
+    die("Cannot write run");
+}
+
+dextcnt_t extcnt_new(size_t nbytes, const char *tmpdir) {
+  dextcnt_t c = _d_calloc(1, sizeof(struct dextcnt_s));
+  c->h = darr(0, _d_extelt_t);
+  c->budget = nbytes;
+  if (tmpdir == NULL) tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL) tmpdir = "/tmp";
+  c->dir = _d_malloc(strlen(tmpdir) + 16);
+  sprintf(c->dir, "%s/dlibXXXXXX", tmpdir);
+  if (mkdtemp(c->dir) == NULL) die("Cannot create a directory in %s", tmpdir);
+  return c;
+}
+
+static int _d_extcmp(const void *p, const void *q) {
+  return strcmp(((const _d_extelt_t *) p)->key, ((const _d_extelt_t *) q)->key);
+}
+
+/* Pack the elements of the table to the front and sort them.  When
+   extcnt_merge does this to the table it keeps, it rehashes the table
+   with _d_exthrekey afterwards so that extcnt_add can go on. */
+
+static size_t _d_extsort(dextcnt_t c) {
+  size_t n = 0;
+  _d_extelt_t *d = (_d_extelt_t *) (c->h->data);
+  for (size_t i = 0, m = (len(c->h) ? cap(c->h) : 0); i < m; i++) {
+    if (d[i].key == NULL) continue;
+    d[n] = d[i];
+    if (i != n) d[i].key = NULL;
+    n++;
+  }
+  qsort(d, n, sizeof(_d_extelt_t), _d_extcmp);
+  return n;
+}
+
+static void _d_extreset(dextcnt_t c) {
+  _d_extelt_t *d = (_d_extelt_t *) (c->h->data);
+  for (size_t i = 0, m = (len(c->h) ? cap(c->h) : 0); i < m; i++)
+    if (d[i].key != NULL) _d_free(d[i].key);
+  darr_free(c->h);
+  c->h = darr(0, _d_extelt_t);
+  c->nbytes = 0;
+}
+
+static void _d_extaddrun(dextcnt_t c, size_t r) {
+  c->run = _d_realloc(c->run, (c->nrun + 1) * sizeof(size_t));
+  c->run[c->nrun++] = r;
+}
+
+static void _d_extspill(dextcnt_t c) {
+  size_t n = _d_extsort(c), r = c->nextrun++;
+  _d_extelt_t *d = (_d_extelt_t *) (c->h->data);
+  _d_extfile_t f = _d_extcreate(c, r);
+  for (size_t i = 0; i < n; i++) _d_extwrite(d[i].key, d[i].cnt, f);
+  _d_extclose(f);
+  _d_extaddrun(c, r);
+  _d_extreset(c);
+}
+
+void extcnt_add(dextcnt_t c, const char *key, size_t n) {
+  size_t l = len(c->h);
+  _d_exthget(c->h, (str_t) key, true)->cnt += n;
+  if (len(c->h) > l) c->nbytes += strlen(key) + 1;
+  if (c->nbytes + cap(c->h) * sizeof(_d_extelt_t) > c->budget) _d_extspill(c);
+}
+
+/* A merge source is a run file or the sorted table (f == NULL); key
+   and cnt hold its current line, read into line (of size size).  The
+   sources are kept in a heap ordered by key. */
+
+typedef struct {
+  _d_extfile_t f;
+  _d_extelt_t *a;
+  size_t i, n;
+  char *key;
+  size_t cnt;
+  char *line;
+  size_t size;
+} _d_extsrc_t;
+
+static bool _d_extnext(_d_extsrc_t *s) {
+  if (s->f == NULL) {
+    if (s->i >= s->n) return false;
+    s->key = s->a[s->i].key;
+    s->cnt = s->a[s->i++].cnt;
+    return true;
+  }
+  if (s->line == NULL) s->line = _d_malloc(s->size = 256);
+  if (_d_extfgets(s->line, s->size, s->f) == NULL) return false;
+  size_t m = strlen(s->line);
+  while ((m > 0) && (s->line[m - 1] != '\n')) {
+    s->line = _d_realloc(s->line, s->size *= 2);
+    if (_d_extfgets(s->line + m, s->size - m, s->f) == NULL) break;
+    m += strlen(s->line + m);
+  }
+  char *l = s->line;
+  char *t = strrchr(l, '\t');
+  if (t == NULL) die("Bad line in a run: %s", l);
+  *t = '\0';
+  s->key = l;
+  s->cnt = strtoull(t + 1, NULL, 10);
+  return true;
+}
+
+static void _d_extsift(_d_extsrc_t **h, size_t n, size_t i) {
+  _d_extsrc_t *x = h[i];
+  for (size_t c; (c = 2 * i + 1) < n; i = c) {
+    if ((c + 1 < n) && (strcmp(h[c + 1]->key, h[c]->key) < 0)) c++;
+    if (strcmp(x->key, h[c]->key) <= 0) break;
+    h[i] = h[c];
+  }
+  h[i] = x;
+}
+
+static void _d_extmerge(_d_extsrc_t *src, size_t nsrc,
+			void (*fn)(const char *key, size_t cnt, void *arg), void *arg) {
+  _d_extsrc_t **h = _d_malloc(nsrc * sizeof(_d_extsrc_t *));
+  size_t n = 0, size = 64;
+  for (size_t i = 0; i < nsrc; i++) if (_d_extnext(&src[i])) h[n++] = &src[i];
+  for (size_t i = n / 2; i-- > 0; ) _d_extsift(h, n, i);
+  char *key = _d_malloc(size);
+  while (n > 0) {
+    size_t l = strlen(h[0]->key) + 1, cnt = 0;
+    if (l > size) key = _d_realloc(key, (size = 2 * l));
+    memcpy(key, h[0]->key, l);
+    while ((n > 0) && !strcmp(h[0]->key, key)) {
+      cnt += h[0]->cnt;
+      if (!_d_extnext(h[0])) h[0] = h[--n];
+      if (n > 0) _d_extsift(h, n, 0);
+    }
+    fn(key, cnt, arg);
+  }
+  _d_free(key);
+  _d_free(h);
+}
+
+static void _d_extopen(dextcnt_t c, _d_extsrc_t *s, size_t r) {
+  char *path = _d_extpath(c, r);
+  s->f = _d_extfopen(path, false);
+  if (s->f == NULL) die("Cannot open %s", path);
+  _d_free(path);
+}
+
+static void _d_extdone(_d_extsrc_t *s) {
+  _d_extfclose(s->f);
+  _d_free(s->line);
+  s->line = NULL;
+}
+
+static void _d_extremove(dextcnt_t c, size_t r) {
+  char *path = _d_extpath(c, r);
+  unlink(path);
+  _d_free(path);
+}
+
+void extcnt_merge(dextcnt_t c, void (*fn)(const char *key, size_t cnt, void *arg), void *arg) {
+  _d_extsrc_t *src = _d_calloc(D_EXTFANIN + 1, sizeof(_d_extsrc_t));
+  while (c->nrun > D_EXTFANIN) {
+    size_t r = c->nextrun++;
+    _d_extfile_t f = _d_extcreate(c, r);
+    for (size_t i = 0; i < D_EXTFANIN; i++) _d_extopen(c, &src[i], c->run[i]);
+    _d_extmerge(src, D_EXTFANIN, _d_extwrite, f);
+    _d_extclose(f);
+    for (size_t i = 0; i < D_EXTFANIN; i++) {
+      _d_extdone(&src[i]);
+      _d_extremove(c, c->run[i]);
+    }
+    c->nrun -= D_EXTFANIN;
+    memmove(c->run, &c->run[D_EXTFANIN], c->nrun * sizeof(size_t));
+    _d_extaddrun(c, r);
+  }
+  for (size_t i = 0; i < c->nrun; i++) _d_extopen(c, &src[i], c->run[i]);
+  _d_extsrc_t *m = &src[c->nrun];
+  *m = (_d_extsrc_t) { NULL, (_d_extelt_t *) (c->h->data), 0, _d_extsort(c), NULL, 0, NULL, 0 };
+  _d_extmerge(src, c->nrun + 1, fn, arg);
+  for (size_t i = 0; i < c->nrun; i++) _d_extdone(&src[i]);
+  _d_free(src);
+  _d_exthrekey(c->h);
+}
+
+void extcnt_free(dextcnt_t c) {
+  for (size_t i = 0; i < c->nrun; i++) _d_extremove(c, c->run[i]);
+  rmdir(c->dir);
+  _d_extreset(c);
+  darr_free(c->h);
+  _d_free(c->run);
+  _d_free(c->dir);
+  _d_free(c);
 }
 
 /* darr_t support code */
@@ -376,6 +1916,22 @@ darr_t _d_darr(size_t nmemb, size_t esize) {
   return a;							
 }
 
+/* Grow the capacity of a past index i.  This is the slow path of
+   val(), kept out of line so that val() stays small; it is also where
+   arrays consult the memory budget. */
+
+void _d_grow(darr_t a, size_t i, size_t esize) {
+  if (i >= (1ULL << _D_LENBITS))
+    die("darr_t cannot hold more than %lu elements.", (1ULL<<_D_LENBITS));
+  _d_memcheck(cap(a) * esize);
+  size_t c = cap(a);
+  do {
+    c <<= 1;
+    _d_dblcap(a);
+  } while (i >= c);
+  a->data = _d_realloc(a->data, c * esize);
+}
+
 void darr_free(darr_t a) {
   _d_free(a->data); _d_free(a);
 }
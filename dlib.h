@@ -65,11 +65,12 @@ To compile your C code with dlib, `#include "dlib.h"` at the beginning
 of your files and add `dlib.c` to the files to be compiled.  My typical
 gcc options are: 
 
-	-O3 -D_GNU_SOURCE -std=c99 -pedantic -Wall
+	-O3 -D_GNU_SOURCE -std=c99 -pedantic -Wall -pthread
 
 I tried to stick with the C99 standard but used some extensions that
 can be turned off.  Use the `-D_GNU_SOURCE` compiler flag if you want
-to compile with these extensions without warnings.  Define the
+to compile with these extensions without warnings.  Use `-pthread` to
+link with POSIX threads and `-lz` to link with zlib.  Define the
 following flags with `-D` compiler options if you don't have, or don't
 want these extensions:
 
@@ -77,6 +78,9 @@ want these extensions:
 	_NO_GETLINE	Do not use GNU getline.
 	_NO_PROC	Do not use the proc filesystem for memory reporting.
 	_NO_MUSABLE	Do not use GNU malloc_usable_size for memory reporting.
+	_NO_PTHREAD	Do not use POSIX threads for parallel operations.
+	_NO_ZLIB	Do not compress the runs of extcnt with zlib.
+	_NO_MMAP	Do not use mmap, read saved arrays into memory instead.
 	NDEBUG		Turn off debug output and assert checks (from assert.h).
 
 */
@@ -90,8 +94,12 @@ want these extensions:
 #include <string.h>		// strspn, strpbrk
 #include <stdint.h>		// uint8_t etc.
 #include <stdbool.h>		// bool, true, false
+#include <stddef.h>		// offsetof
 #include <assert.h>		// assert, turn off with NDEBUG
 #include <errno.h>		// errno
+#ifdef __SSE2__
+#include <emmintrin.h>		// SSE2 intrinsics for D_TAGHASH
+#endif
 
 /* Define some convenience types */
 
@@ -239,7 +247,7 @@ something like `chop` or `trim` eventually.
 extern size_t split(char *str, const char *delim, char **argv, size_t argv_len);
 
 /* error checking, byte counting memory allocation: not ready for prime-time.
-TODO: _d_memsize not thread-safe, use pthread-lock?
+_d_memsize is updated atomically unless compiled with _NO_PTHREAD.
 */
 extern int64_t _d_memsize;
 extern void *_d_malloc(size_t size);
@@ -248,6 +256,27 @@ extern void *_d_realloc(void *ptr, size_t size);
 extern char *_d_strdup(const char *s);
 extern void _d_free(void *ptr);
 
+/* _d_memcheck(n) is called before an array or table grows by about n
+   bytes, and calls the dmemprune callbacks if that would take
+   _d_memsize past the dmembudget limit (see below).  It is only
+   called from growth paths that are already out of line (_d_grow and
+   the hash table resize), so lookups do not pay for it.  _d_pruning
+   is set while the callbacks run.  xget_batch calls _d_memcheck
+   before the batch if it may grow the table and then sets _d_pruning
+   itself, so that no callback drops the keys of a batch before it
+   returns. */
+
+extern size_t _d_membudget;
+extern int _d_pruning;
+extern void dmembudget(size_t nbytes);
+extern void dmemprune(void (*fn)(void *arg), void *arg);
+extern void _d_memprune(size_t n);
+
+static inline void _d_memcheck(size_t n) {
+  if ((_d_membudget != 0) && (_d_memsize + (int64_t) n > (int64_t) _d_membudget))
+    _d_memprune(n);
+}
+
 
 /* fast memory allocation: not thread-safe 
 TODO: pass memory chunk as an argument.
@@ -346,23 +375,52 @@ Oh well, don't do it.
 #define _d_inclen(a) ((a)->bits++)
 #define _d_setlen(a,l) ((a)->bits = ((((a)->bits >> _D_LENBITS) << _D_LENBITS) | (l)))
 
+extern void _d_grow(darr_t a, size_t i, size_t esize);
+
 static inline ptr_t _d_boundcheck(darr_t a, size_t i, size_t esize) {
   if (i >= len(a)) {
-    if (i >= (1ULL << _D_LENBITS))
-      die("darr_t cannot hold more than %lu elements.", (1ULL<<_D_LENBITS));
+    if (i >= cap(a)) _d_grow(a, i, esize);
     _d_setlen(a, i + 1);
-    size_t c = cap(a);
-    if (i >= c) {
-      do {
-	c <<= 1;
-	_d_dblcap(a);
-      } while (i >= c);
-      a->data = _d_realloc(a->data, c * esize);
-    }
   }
   return (((char *)(a->data)) + i * esize);
 }
 
+/** Arrays (and hash tables) that take a long time to build can be
+saved to a file once and mapped into memory by later runs:
+
+* `void darr_save(darr_t a, type t, const char *path)` writes the
+  `len(a)` elements of `a` to `path`.
+* `darr_t darr_mmap(const char *path, type t)` maps the array saved in
+  `path` into memory and returns it.  Nothing is read until it is
+  accessed and processes that map the same file share its pages
+  through the page cache, so opening a large array is instant.
+* `void darr_unmap(darr_t a)` unmaps an array returned by `darr_mmap`
+  (use it instead of `darr_free`).
+
+A mapped array is read-only: writing to it (or growing it with `val`)
+will crash.  The elements are saved as raw bytes, so pointers in them
+are meaningless in another process and the file can only be read on
+a machine with the same byte order and type sizes.  If dlib is
+compiled with `_NO_MMAP` the file is read into memory instead.
+
+*/
+
+/* A mapped array is preceded by the header it was saved with.  The
+   string keys of a mapped table are offsets into the blob after its
+   data, which starts at _d_mblob(a) + 1 (0 stands for NULL). */
+
+typedef struct _d_fhead_s {
+  uint64_t magic, esize, bits, nelem, nbytes, koff, blob, unused;
+} _d_fhead_t;
+
+#define _D_NOKEY ((size_t) -1)
+#define _d_mblob(a) (((const char *) ((a)->data)) + (((const _d_fhead_t *) ((a)->data)) - 1)->nbytes - 1)
+#define darr_save(a, t, path) _d_save((a), sizeof(t), len(a), len(a) * sizeof(t), _D_NOKEY, (path))
+#define darr_mmap(path, t) _d_mmap((path), sizeof(t))
+extern void _d_save(darr_t a, size_t esize, size_t nelem, size_t nbytes, size_t koff, const char *path);
+extern darr_t _d_mmap(const char *path, size_t esize);
+extern void darr_unmap(darr_t a);
+
 /** Hash tables
 ---------------
 
@@ -423,26 +481,189 @@ table types you use, you will hopefully never need `D_HASH` again.
 
 */
 
+/* _d_hmax(c, lf) is the number of elements a hash table with capacity
+   c can hold before it is resized, given a load factor of lf/16.
+   _d_hbits(n, lf) is log2 of the smallest capacity that can hold n
+   elements without a resize.  lf should be between 1 and 15: 0 would
+   never let a table hold anything, and 16 would let it fill up so
+   that a probe for a missing key never ends.  The load factor of
+   D_HASH_LOAD is checked at compile time with a typedef of an array
+   whose size is negative if it is out of range. */
+
+#ifndef D_HLOAD
+#define D_HLOAD 14
+#endif
+
+#if (D_HLOAD < 1) || (D_HLOAD > 15)
+#error "D_HLOAD should be between 1 and 15"
+#endif
+
+#define _d_hmax(c, lf) (((c) >> 4) * (lf) + ((((c) & 15) * (lf)) >> 4))
+#define _d_capbits(a) ((a)->bits >> _D_LENBITS)
+#define _d_setcapbits(a,b) ((a)->bits = ((((uint64_t) (b)) << _D_LENBITS) | len(a)))
+
+/* Tables with at most D_HMIN slots are not hashed: their elements are
+   packed at the front of the array in insertion order and searched
+   linearly, and they are resized only when all slots are full.
+   _d_hfull(l, c, lf) is true if a table of l elements and capacity c
+   has to grow before another insert. */
+
+#ifndef D_HMIN
+#define D_HMIN 8
+#endif
+
+#define _d_hfull(l, c, lf) (((c) <= D_HMIN) ? ((l) >= (c)) : ((l) >= _d_hmax(c, lf)))
+
+/* xget_batch hashes D_BATCH keys and prefetches their home slots
+   before probing for any of them.  It is not inlined: it works on a
+   whole batch, so the call costs little next to its own loop. */
+
+#ifndef D_BATCH
+#define D_BATCH 16
+#endif
+
+/* The slow paths of generated functions (e.g. growing a table) are
+   declared _d_noinline so that the fast paths stay small enough to
+   be inlined into their callers. */
+
+#ifdef __GNUC__
+#define _d_noinline __attribute__((noinline, unused))
+#else
+#define _d_noinline inline
+#endif
+
+#ifdef __GNUC__
+#define _d_prefetch(p) __builtin_prefetch(p)
+#else
+#define _d_prefetch(p) ((void) (p))
+#endif
+
+static inline size_t _d_hbits(size_t n, size_t lf) {
+  size_t b = 0;
+  while (n >= _d_hmax(1ULL << b, lf)) b++;
+  return b;
+}
+
+/* A frozen table of n elements is a minimal perfect hash: its keys are
+   split into 2^b >= n/4 buckets, and each bucket stores a displacement
+   d chosen by _d_mph so that _d_mphpos maps the keys of the bucket to
+   free slots.  The elements are followed by the displacements and the
+   number of fallback slots at the end, which hold the keys whose hash
+   value equals that of another key. */
+
+#define _D_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+#define _d_mphbucket(hv, nb) ((size_t) (d_mix64(hv) >> 32) & ((nb) - 1))
+#define _d_mphpos(hv, d, n) ((size_t) (d_mix64((hv) + ((uint64_t) (d) + 1) * 0x9E3779B97F4A7C15ULL) % (n)))
+#define _d_mphdisp(f, esize) ((uint32_t *) (((char *) ((f)->data)) + _D_ALIGN(len(f) * (esize))))
+extern void _d_mph(const size_t *hv, size_t n, size_t nb, uint32_t *disp, size_t *pos);
+
+static inline uint64_t d_mix64(uint64_t x) {
+  x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33; return x;
+}
+
+static inline size_t _d_mphbits(size_t n) {
+  size_t b = 0;
+  while ((4ULL << b) < n) b++;
+  return b;
+}
+
 #define D_HASH(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull) \
+  D_HASH_LOAD(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull, D_HLOAD)
+
+#define D_HASH_LOAD(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull, _load) \
+  _D_HASH_LOAD(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull, _load) \
+  _D_HASH_IO(_pre, _etype, _D_NOKEY)
+
+/* _D_HASH_IO defines save and mmap for a table whose elements have a
+   string key at byte offset _koff, or no pointers if it is _D_NOKEY. */
+
+#define _D_HASH_IO(_pre, _etype, _koff)					\
+  static inline void _pre##save(darr_t h, const char *path) {		\
+    _d_save(h, sizeof(_etype), cap(h), cap(h) * sizeof(_etype), _koff, path); \
+  }									\
+									\
+  static inline void _pre##fsave(darr_t f, const char *path) {		\
+    _d_save(f, sizeof(_etype), len(f), _D_ALIGN(len(f) * sizeof(_etype)) + \
+	    (cap(f) + 1) * sizeof(uint32_t), _koff, path);		\
+  }									\
+									\
+  static inline darr_t _pre##mmap(const char *path) {			\
+    return _d_mmap(path, sizeof(_etype));				\
+  }									\
+
+#define _D_HASH_LOAD(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull, _load) \
+  typedef char _pre##loadcheck_t[(((_load) >= 1) && ((_load) <= 15)) ? 1 : -1]; \
   									\
-  static inline size_t _pre##idx(darr_t h, _ktype k) {			\
+  static inline size_t _pre##hidx(darr_t h, _ktype k, size_t hv) {	\
     size_t idx, step;							\
     size_t mask = cap(h) - 1;						\
     _etype *data = (_etype*) h->data;					\
-    for (idx = (_khash(k) & mask), step = 0;				\
+    if (mask < D_HMIN) {						\
+      for (idx = 0; (idx <= mask) && !_isnull(data[idx]) &&		\
+	     !_kmatch(k, _keyof(data[idx])); idx++);			\
+      return idx;							\
+    }									\
+    for (idx = (hv & mask), step = 0;					\
 	 (!_isnull(data[idx]) &&					\
 	  !_kmatch(k, _keyof(data[idx])));				\
 	 step++, idx = ((idx+step) & mask));				\
     return idx;								\
+  }									\
+									\
+  static inline size_t _pre##idx(darr_t h, _ktype k) {			\
+    return _pre##hidx(h, k, (cap(h) <= D_HMIN) ? 0 : _khash(k));	\
   }									\
   									\
-  static inline void _pre##resize(darr_t h) {				\
+  typedef struct { _etype *d1, *d2; size_t c1, c2; uint8_t *claim; } _pre##pargs_t; \
+									\
+  static inline void _pre##pfill(void *arg, size_t tid, size_t n) {	\
+    _pre##pargs_t *a = (_pre##pargs_t *) arg;				\
+    size_t end = a->c2 / n * (tid + 1);					\
+    if (tid == n - 1) end = a->c2;					\
+    for (size_t i2 = a->c2 / n * tid; i2 < end; _mknull(a->d2[i2++]));	\
+  }									\
+									\
+  static inline void _pre##pmove(void *arg, size_t tid, size_t n) {	\
+    _pre##pargs_t *a = (_pre##pargs_t *) arg;				\
+    size_t mask = a->c2 - 1;						\
+    size_t end = a->c1 / n * (tid + 1);					\
+    if (tid == n - 1) end = a->c1;					\
+    for (size_t i1 = a->c1 / n * tid; i1 < end; i1++) {		\
+      if (_isnull(a->d1[i1])) continue;					\
+      size_t idx = (_khash(_keyof(a->d1[i1])) & mask), step = 0;	\
+      while (!_d_claim(&a->claim[idx]))					\
+	idx = ((idx + (++step)) & mask);				\
+      a->d2[idx] = a->d1[i1];						\
+    }									\
+  }									\
+									\
+  static inline void _pre##rehash(darr_t h, size_t b) {		\
     size_t c1 = cap(h);							\
     _etype *d1 = (_etype *) (h->data);					\
-    _d_dblcap(h);							\
+    _d_setcapbits(h, b);						\
     size_t c2 = cap(h);							\
+    if (len(h) == 0) {							\
+      _etype *d = h->data = _d_realloc(d1, c2 * sizeof(_etype));		\
+      for (size_t i = 0; i < c2; _mknull(d[i++]));			\
+      return;								\
+    }									\
+    if (c2 <= D_HMIN) {							\
+      _etype *d = h->data = _d_realloc(d1, c2 * sizeof(_etype));	\
+      for (size_t i = c1; i < c2; _mknull(d[i++]));			\
+      return;								\
+    }									\
     h->data = _d_malloc(c2 * sizeof(_etype));				\
     _etype *d2 = (_etype *) (h->data);					\
+    if ((_d_nthreads > 1) && (c1 >= D_PMIN)) {				\
+      _pre##pargs_t a = { d1, d2, c1, c2, _d_calloc(c2, 1) };		\
+      _d_parallel(_pre##pfill, &a);					\
+      _d_parallel(_pre##pmove, &a);					\
+      _d_free(a.claim);							\
+      _d_free(d1);							\
+      return;								\
+    }									\
     for (size_t i2 = 0; i2 < c2; _mknull(d2[i2++]));			\
     for (size_t i1 = 0; i1 < c1; i1++) {				\
       if (_isnull(d1[i1])) continue;					\
@@ -452,6 +673,19 @@ table types you use, you will hopefully never need `D_HASH` again.
     _d_free(d1);							\
   }									\
 									\
+  static _d_noinline void _pre##resize(darr_t h) {			\
+    _d_memcheck(cap(h) * sizeof(_etype));				\
+    if (_d_hfull(len(h), cap(h), _load))				\
+      _pre##rehash(h, _d_capbits(h) + 1);				\
+  }									\
+									\
+  static inline void _pre##reserve(darr_t h, size_t n) {		\
+    size_t b = _d_hbits(n, _load);					\
+    if (b <= _d_capbits(h)) return;					\
+    _d_memcheck((1ULL << b) * sizeof(_etype));				\
+    _pre##rehash(h, b);							\
+  }									\
+									\
   static inline _etype *_pre##get(darr_t h, _ktype k, bool insert) {	\
     size_t l = len(h);							\
     size_t c = cap(h);							\
@@ -461,9 +695,9 @@ table types you use, you will hopefully never need `D_HASH` again.
       for (size_t i = 0; i < c; _mknull(d[i++]));			\
     }									\
     size_t idx = _pre##idx(h, k);					\
-    if (_isnull(d[idx])) {						\
+    if ((idx == c) || _isnull(d[idx])) {				\
       if (!insert) return NULL;						\
-      if (l >= (c >> 1) + (c >> 2) + (c >> 3)) {			\
+      if (_d_hfull(l, c, _load)) {					\
 	_pre##resize(h);						\
 	d = (_etype *) (h->data);					\
         idx = _pre##idx(h, k);						\
@@ -473,7 +707,534 @@ table types you use, you will hopefully never need `D_HASH` again.
     }									\
     return &d[idx];							\
   }									\
+									\
+  static _d_noinline void _pre##get_batch(darr_t h, _ktype const *keys, \
+					  size_t n, bool insert, _etype **out) { \
+    if (insert && _d_hfull(len(h) + n, cap(h), _load))			\
+      _d_memcheck(cap(h) * sizeof(_etype));				\
+    size_t c0 = cap(h), i = 0, hv[D_BATCH];				\
+    void *d0 = h->data;							\
+    bool held = _d_cas(&_d_pruning, 0, 1);				\
+    for (; (i < n) && ((len(h) == 0) || (cap(h) <= D_HMIN)); i++)	\
+      out[i] = _pre##get(h, keys[i], insert);				\
+    for (; i < n; i += D_BATCH) {					\
+      size_t m = (n - i < D_BATCH) ? (n - i) : D_BATCH;			\
+      size_t mask = cap(h) - 1;						\
+      _etype *d = (_etype *) (h->data);					\
+      for (size_t j = 0; j < m; j++) {					\
+	hv[j] = _khash(keys[i + j]);					\
+	_d_prefetch(&d[hv[j] & mask]);					\
+      }									\
+      for (size_t j = 0; j < m; j++) {					\
+	size_t idx = _pre##hidx(h, keys[i + j], hv[j]);			\
+	d = (_etype *) (h->data);					\
+	if (_isnull(d[idx])) {						\
+	  if (!insert) { out[i + j] = NULL; continue; }			\
+	  if (_d_hfull(len(h), cap(h), _load)) {			\
+	    _pre##resize(h);						\
+	    d = (_etype *) (h->data);					\
+	    idx = _pre##hidx(h, keys[i + j], hv[j]);			\
+	  }								\
+	  d[idx] = _einit(keys[i + j]);					\
+	  _d_inclen(h);							\
+	}								\
+	out[i + j] = &d[idx];						\
+      }									\
+    }									\
+    if ((cap(h) != c0) || (h->data != d0))				\
+      _pre##get_batch(h, keys, n, false, out);				\
+    if (held) _d_store(&_d_pruning, 0);					\
+  }									\
+									\
+  static inline void _pre##add(darr_t h, _etype *e, size_t hv,		\
+			       void (*combine)(_etype *, const _etype *)) { \
+    if (len(h) == 0) {							\
+      _etype *d = (_etype *) (h->data);					\
+      for (size_t i = 0, c = cap(h); i < c; _mknull(d[i++]));		\
+    }									\
+    size_t idx = _pre##hidx(h, _keyof(*e), hv);				\
+    _etype *d = (_etype *) (h->data);					\
+    if ((idx < cap(h)) && !_isnull(d[idx])) {				\
+      if (combine != NULL) combine(&d[idx], e);				\
+      return;								\
+    }									\
+    if (_d_hfull(len(h), cap(h), _load)) {				\
+      _pre##resize(h);							\
+      d = (_etype *) (h->data);						\
+      idx = _pre##hidx(h, _keyof(*e), hv);				\
+    }									\
+    d[idx] = *e;							\
+    _d_inclen(h);							\
+  }									\
+									\
+  static _d_noinline void _pre##merge(darr_t dst, darr_t src,		\
+				      void (*combine)(_etype *, const _etype *)) { \
+    if (len(src) == 0) return;						\
+    _pre##reserve(dst, len(dst) + len(src));				\
+    _etype *s = (_etype *) (src->data);					\
+    for (size_t i = 0, c = cap(src); i < c; i++) {			\
+      if (_isnull(s[i])) continue;					\
+      _pre##add(dst, &s[i], _khash(_keyof(s[i])), combine);		\
+    }									\
+  }									\
+									\
+  typedef struct { _etype *e; size_t hv; } _pre##mitem_t;		\
+  typedef struct {							\
+    darr_t *src; size_t nsrc;						\
+    void (*combine)(_etype *, const _etype *);				\
+    size_t *off; _pre##mitem_t *items; darr_t *part;			\
+    _pre##pargs_t m;							\
+  } _pre##margs_t;							\
+									\
+  static inline void _pre##mscan(void *arg, size_t tid, size_t n, bool fill) { \
+    _pre##margs_t *a = (_pre##margs_t *) arg;				\
+    size_t *off = &a->off[tid * n];					\
+    for (size_t j = 0; j < a->nsrc; j++) {				\
+      darr_t h = a->src[j];						\
+      if (len(h) == 0) continue;					\
+      _etype *d = (_etype *) (h->data);					\
+      size_t c = cap(h);						\
+      size_t end = (tid == n - 1) ? c : c / n * (tid + 1);		\
+      for (size_t i = c / n * tid; i < end; i++) {			\
+	if (_isnull(d[i])) continue;					\
+	size_t hv = _khash(_keyof(d[i]));				\
+	size_t p = _d_part(hv, n);					\
+	if (fill) a->items[off[p]] = (_pre##mitem_t) { &d[i], hv };	\
+	off[p]++;							\
+      }									\
+    }									\
+  }									\
+									\
+  static inline void _pre##mcount(void *arg, size_t tid, size_t n) {	\
+    _pre##mscan(arg, tid, n, false);					\
+  }									\
+									\
+  static inline void _pre##mfill(void *arg, size_t tid, size_t n) {	\
+    _pre##mscan(arg, tid, n, true);					\
+  }									\
+									\
+  static inline void _pre##mpart(void *arg, size_t p, size_t n) {	\
+    _pre##margs_t *a = (_pre##margs_t *) arg;				\
+    darr_t t = a->part[p];						\
+    for (size_t i = (p == 0 ? 0 : a->off[(n-1) * n + p-1]),		\
+	   end = a->off[(n-1) * n + p]; i < end; i++)			\
+      _pre##add(t, a->items[i].e, a->items[i].hv, a->combine);		\
+  }									\
+									\
+  static inline void _pre##mmove(void *arg, size_t p, size_t n) {	\
+    _pre##margs_t *a = (_pre##margs_t *) arg;				\
+    _pre##pargs_t m = a->m;						\
+    (void) n;								\
+    if (len(a->part[p]) == 0) return;					\
+    m.d1 = (_etype *) (a->part[p]->data);				\
+    m.c1 = cap(a->part[p]);						\
+    _pre##pmove(&m, 0, 1);						\
+  }									\
+									\
+  static _d_noinline void _pre##merge_all(darr_t dst, darr_t *src, size_t nsrc, \
+					  void (*combine)(_etype *, const _etype *)) { \
+    size_t n = _d_nthreads;						\
+    _pre##margs_t a;							\
+    a.src = _d_malloc((nsrc + 1) * sizeof(darr_t));			\
+    a.src[0] = dst;							\
+    memcpy(&a.src[1], src, nsrc * sizeof(darr_t));			\
+    a.nsrc = nsrc + 1;							\
+    a.combine = combine;						\
+    a.off = _d_calloc(n * n, sizeof(size_t));				\
+    _d_parallel(_pre##mcount, &a);					\
+    size_t total = 0;							\
+    for (size_t p = 0; p < n; p++) {					\
+      for (size_t t = 0; t < n; t++) {					\
+	size_t cnt = a.off[t * n + p];					\
+	a.off[t * n + p] = total;					\
+	total += cnt;							\
+      }									\
+    }									\
+    a.items = _d_malloc(total * sizeof(_pre##mitem_t));		\
+    _d_parallel(_pre##mfill, &a);					\
+    a.part = _d_malloc(n * sizeof(darr_t));				\
+    for (size_t p = 0; p < n; p++) a.part[p] = darr(0, _etype);	\
+    _d_parallel(_pre##mpart, &a);					\
+    _d_free(a.items);							\
+    size_t ulen = 0;							\
+    for (size_t p = 0; p < n; p++) ulen += len(a.part[p]);		\
+    _d_free(dst->data);							\
+    dst->bits = 0;							\
+    _d_setcapbits(dst, _d_hbits(ulen, _load));				\
+    a.m.c2 = cap(dst);							\
+    a.m.d2 = dst->data = _d_malloc(a.m.c2 * sizeof(_etype));		\
+    a.m.claim = _d_calloc(a.m.c2, 1);					\
+    _d_parallel(_pre##pfill, &a.m);					\
+    if (a.m.c2 <= D_HMIN) {						\
+      for (size_t p = 0, j = 0; p < n; p++) {				\
+	_etype *d = (_etype *) (a.part[p]->data);			\
+	for (size_t i = 0, c = (len(a.part[p]) ? cap(a.part[p]) : 0); i < c; i++) \
+	  if (!_isnull(d[i])) a.m.d2[j++] = d[i];			\
+      }									\
+    } else {								\
+      _d_parallel(_pre##mmove, &a);					\
+    }									\
+    for (size_t p = 0; p < n; p++) darr_free(a.part[p]);		\
+    _d_setlen(dst, ulen);						\
+    _d_free(a.m.claim);							\
+    _d_free(a.part);							\
+    _d_free(a.off);							\
+    _d_free(a.src);							\
+  }									\
+									\
+  static inline void _pre##rekey(darr_t h) {				\
+    if (len(h) == 0) return;						\
+    size_t c = cap(h), n = 0;						\
+    _etype *d1 = (_etype *) (h->data);					\
+    _etype *d2 = h->data = _d_malloc(c * sizeof(_etype));		\
+    for (size_t i = 0; i < c; _mknull(d2[i++]));			\
+    for (size_t i = 0; i < c; i++) {					\
+      if (_isnull(d1[i])) continue;					\
+      d2[_pre##idx(h, _keyof(d1[i]))] = d1[i];				\
+      n++;								\
+    }									\
+    _d_setlen(h, n);							\
+    _d_free(d1);							\
+  }									\
+									\
+  static inline darr_t _pre##freeze(darr_t h) {				\
+    size_t n = len(h), j = 0;						\
+    darr_t f = _d_malloc(sizeof(struct darr_s));			\
+    f->bits = n;							\
+    _d_setcapbits(f, _d_mphbits(n));					\
+    f->data = _d_malloc(_D_ALIGN(n * sizeof(_etype)) + (cap(f) + 1) * sizeof(uint32_t)); \
+    size_t *hv = _d_calloc(n, sizeof(size_t));				\
+    size_t *pos = _d_malloc(n * sizeof(size_t));			\
+    _etype *d = (_etype *) (h->data);					\
+    _etype *e = (_etype *) (f->data);					\
+    for (size_t i = 0, c = (n ? cap(h) : 0); i < c; i++)		\
+      if (!_isnull(d[i])) hv[j++] = _khash(_keyof(d[i]));		\
+    _d_mph(hv, n, cap(f), _d_mphdisp(f, sizeof(_etype)), pos);		\
+    j = 0;								\
+    for (size_t i = 0, c = (n ? cap(h) : 0); i < c; i++)		\
+      if (!_isnull(d[i])) e[pos[j++]] = d[i];				\
+    _d_free(pos);							\
+    _d_free(hv);							\
+    return f;								\
+  }									\
+									\
+  static inline dbloom_t _pre##bloom(darr_t h) {			\
+    dbloom_t b = bloom_new(len(h));					\
+    _etype *d = (_etype *) (h->data);					\
+    for (size_t i = 0, c = (len(h) ? cap(h) : 0); i < c; i++)		\
+      if (!_isnull(d[i])) bloom_add(b, _khash(_keyof(d[i])));		\
+    return b;								\
+  }									\
+									\
+  static inline _etype *_pre##bget(darr_t h, dbloom_t b, _ktype k) {	\
+    if (len(h) == 0) return NULL;					\
+    size_t hv = _khash(k);						\
+    if (!bloom_has(b, hv)) return NULL;					\
+    size_t idx = _pre##hidx(h, k, hv);					\
+    _etype *d = (_etype *) (h->data);					\
+    return ((idx < cap(h)) && !_isnull(d[idx])) ? &d[idx] : NULL;	\
+  }									\
+									\
+  static inline _etype *_pre##fget(darr_t f, _ktype k) {		\
+    size_t n = len(f);							\
+    if (n == 0) return NULL;						\
+    size_t hv = _khash(k);						\
+    uint32_t *disp = _d_mphdisp(f, sizeof(_etype));			\
+    size_t m = n - disp[cap(f)];					\
+    _etype *e = (_etype *) (f->data);					\
+    size_t i = _d_mphpos(hv, disp[_d_mphbucket(hv, cap(f))], m);	\
+    if (_kmatch(k, _keyof(e[i]))) return &e[i];				\
+    for (i = m; (i < n) && !_kmatch(k, _keyof(e[i])); i++);		\
+    return (i < n) ? &e[i] : NULL;					\
+  }									\
+
+
+
+/** A table resizes itself (doubling its capacity) when the number of
+elements reaches a fraction of its capacity called the load factor.
+The load factor is `D_HLOAD/16` where `D_HLOAD` defaults to 14 (7/8).
+A lower load factor makes lookups faster, a higher one saves memory.
+`D_HASH_LOAD` takes a tenth argument that gives the load factor of one
+table type in sixteenths (between 1 and 15), e.g. the following table
+resizes when it is half full:
+
+	D_HASH_LOAD(s, strcnt_t, char *, keyof, strmatch, fnv1a, newcnt, keyisnull, keymknull, 8)
+
+The capacity given to `darr(n, t)` is a raw capacity that does not
+take the load factor into account.  `D_HASH` also defines:
+
+	void xreserve(darr_t htable, size_t n);
 
+which grows the table (if necessary) so that it can hold `n` elements
+without a resize.  A table whose final size is known can be built
+without any rehashing by calling `xreserve` before the first `xget`.
+The other hash table generators below use `D_HLOAD` for all tables.
+
+Tables with at most `D_HMIN` (default 8) slots are not hashed at
+all: their elements are kept at the front of the array and `xget`
+compares the key with each of them, which is faster than hashing for
+a handful of keys and lets a small table fill all of its slots.  A
+table switches to hashing when it grows past `D_HMIN` slots.  This
+makes the many small tables of a nested design (e.g. the successors
+of each word) smaller and faster.
+
+*/
+
+/** Growing a large table can take a long time because every element
+has to be moved to a new array.  If `dthreads(n)` has been called with
+`n > 1`, tables generated by `D_HASH` that have at least `D_PMIN`
+(default `1<<20`) slots are resized by `n` threads, each moving a slice
+of the old array and claiming free slots in the new array atomically.
+`keyof`, `khash` and `isnull` should be safe to call from multiple
+threads for this to work (they usually are).  Parallel resizing is not
+available if dlib is compiled with `_NO_PTHREAD`.
+
+*/
+
+#ifndef D_PMIN
+#define D_PMIN (1<<20)
+#endif
+
+/** A long job that runs out of memory dies in `_d_malloc`.  To keep
+memory use in check instead, a program can set a budget and register
+functions that free memory when the budget is about to be exceeded:
+
+	void dmembudget(size_t nbytes);
+	void dmemprune(void (*fn)(void *arg), void *arg);
+
+Before a `D_HASH` table or a `darr_t` (through `val`) grows, the bytes
+it is about to allocate are added to `_d_memsize` (the number of bytes
+allocated by dlib), and if the sum is above `nbytes`, the functions
+registered with `dmemprune` are called with their `arg` in the order
+they were registered, until the sum is within the budget again.  A
+function can e.g. remove the elements with small counts from a table
+(set their keys to null in a `forhash` loop and call `xrekey`), or
+write a table to a file and empty it.  If the table that was about to
+grow has room again afterwards, it does not grow.  The functions are
+called by the thread that grows the table, one thread at a time, and
+growth caused by the functions themselves does not call them again.
+`xget_batch` calls them before a batch that may grow the table and
+not during the batch, which would lose the pointers it returns.  If
+they cannot free enough memory, the table grows anyway.
+`dmembudget(0)` (the default) turns the budget off and forgets the
+registered functions.  `_d_memsize` is only maintained if dlib is
+compiled without `NDEBUG` and `_NO_MUSABLE`, so the budget has no
+effect otherwise.
+
+	void prune(void *h) { ... }
+	dmembudget(200ULL << 30);
+	dmemprune(prune, counts);
+
+*/
+
+/** A lookup in a table much larger than the cache usually waits for a
+cache miss on its slot, and the next lookup does not start until it is
+done.  When many keys are available at once (e.g. all the tokens of a
+line), `D_HASH` also defines:
+
+	void xget_batch(darr_t htable, ktype const *keys, size_t n, bool insert, etype **out);
+
+which sets `out[i] = xget(htable, keys[i], insert)` for `i < n`.  It
+hashes `D_BATCH` (default 16) keys at a time and prefetches their
+slots before looking any of them up, so their cache misses overlap.
+Keys are inserted in order, and all pointers in `out` are valid when
+it returns even if the table was resized.  It only helps for large
+tables: the slots of a table that fits in the cache are found just as
+fast one at a time.
+
+*/
+
+/** Programs that split their work by thread or by file often end up
+with many tables of the same type that need to be combined.  `D_HASH`
+also defines:
+
+	void xmerge(darr_t dst, darr_t src, void (*combine)(etype *d, const etype *s));
+	void xmerge_all(darr_t dst, darr_t *src, size_t n, void (*combine)(etype *d, const etype *s));
+
+`xmerge` adds the elements of `src` to `dst`.  It grows `dst` once to
+hold both tables, so it never resizes during the merge (at the cost of
+some slack if the tables share many keys).  An element whose key is
+not in `dst` is copied as is, without calling `einit`.  If the key is
+already in `dst`, `combine` is called with the two elements (e.g. to
+add the counts), or `src` is ignored if `combine` is `NULL`.
+`xmerge_all` merges the `n` tables in the array `src` into `dst`
+using `dthreads` threads: the elements are partitioned by their hash
+values, each thread combines one partition into a private table, and
+`dst` is rebuilt once with its final size.  `combine` should give the
+same result in any order.  The elements of `src` tables are copied
+into `dst`, so free the `src` tables with `darr_free` but do not free
+their keys.
+
+	void addcnt(strcnt_t *d, const strcnt_t *s) { d->cnt += s->cnt; }
+	smerge_all(total, counts, nfiles, addcnt);
+
+*/
+
+/* Support for parallel operations: _d_parallel calls fn(arg, tid, n)
+   for tid = 0..n-1 on n = _d_nthreads threads and waits for all of
+   them to finish.  _d_cas(p, o, n) atomically replaces *p with n if
+   it is equal to o and returns true if it did.  _d_claim atomically
+   marks a byte and returns true if it was not marked before.  _d_xadd
+   atomically adds to *p and returns the old value, and _d_or
+   atomically ors v into *p. */
+
+extern size_t _d_nthreads;
+extern void dthreads(size_t n);
+extern void _d_parallel(void (*fn)(void *arg, size_t tid, size_t n), void *arg);
+#ifdef _NO_PTHREAD
+#define _d_cas(p, o, n) ((*(p) == (o)) ? ((*(p) = (n)), true) : false)
+#define _d_load(p) (*(p))
+#define _d_store(p, v) (*(p) = (v))
+#define _d_xadd(p, v) ((*(p) += (v)) - (v))
+#define _d_or(p, v) (*(p) |= (v))
+#define datomic_add(x, d) ((x) += (d))
+#else
+#define _d_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define _d_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define _d_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define _d_xadd(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define _d_or(p, v) __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+#define datomic_add(x, d) __atomic_add_fetch(&(x), (d), __ATOMIC_RELAXED)
+#endif
+#define datomic_inc(x) datomic_add((x), 1)
+#define _d_claim(p) _d_cas((p), 0, 1)
+#define _d_part(hv, n) ((size_t) (((hv) ^ ((hv) >> 32)) % (n)))
+
+/** The key of an element should not be changed while it is in a
+table, because the element would no longer be found where its new
+key hashes to.  When many keys have to change at once (e.g. after
+`symtable_renumber`), change them in a `forhash` loop and then call:
+
+	void xrekey(darr_t htable);
+
+which moves every element to the slot of its current key.  Elements
+that became empty (e.g. their key was set to 0 with `isnull` testing
+for 0) are dropped.  Two elements should not end up with the same key.
+
+*/
+
+/** A table that is built once and then only queried (e.g. a
+vocabulary loaded at startup) can be frozen into a more compact form
+that answers every lookup with a single probe.  `D_HASH` also defines:
+
+	darr_t xfreeze(darr_t htable);
+	etype *xfget(darr_t frozen, ktype key);
+
+`xfreeze` returns a new array holding the `len(htable)` elements of
+`htable` with no empty slots, arranged by a minimal perfect hash
+function: the keys are split into buckets of about 2-4 keys, and each
+bucket stores a 32-bit displacement that sends its keys to distinct
+slots.  The displacements cost 1-2 bytes per key, against the empty
+slots of a hash table which cost `(1/load - 1)` elements per key.
+`xfget` hashes the key once, reads the displacement of its bucket,
+and checks the key of the one element it points to, returning `NULL`
+if it does not match.  Freezing is several times slower than building
+the table (about a microsecond per key for large tables).  The
+elements are copied, so `htable` can be freed with `darr_free` but its
+keys should not be.  Two keys with the same `khash` value cannot be
+separated by any displacement, so the second one goes to a fallback
+slot at the end of the array, which `xfget` scans when the key it
+finds does not match.  A good `khash` leaves no such keys; each one
+makes all the misses of `xfget` slower.  A frozen array is read-only:
+its elements can be iterated as `val(frozen, i, etype)` for `i <
+len(frozen)` and it is freed with `darr_free`, but it should not be
+given to `xget` or grown.
+`d_mix64(x)` is the integer mixer used to derive the bucket and slot
+from the hash value; it is also a good `khash` for integer keys.
+
+*/
+
+/** `D_HASH` also defines functions to save a table to a file and map
+it back into memory (see `darr_save` and `darr_mmap`):
+
+	void xsave(darr_t htable, const char *path);
+	void xfsave(darr_t frozen, const char *path);
+	darr_t xmmap(const char *path);
+
+`xsave` saves a hash table and `xfsave` a table returned by `xfreeze`.
+The table returned by `xmmap` can be queried with `xget(h, k, false)`
+(or `xfget`) and iterated, but not modified, and is released with
+`darr_unmap`.  This only works for elements without pointers, e.g.
+with integer keys or `sym_t` keys (see the symbol table below).
+Tables defined with `D_STRHASH` or `D_STRSET` are the exception: their
+string keys are written to a blob after the elements, and each saved
+key is the offset of its string in the blob.  The mapping is not
+modified, so opening the table is instant and its pages are shared by
+every process that maps it.  These tables are queried and read with:
+
+	etype *xmget(darr_t mapped, const char *key);
+	etype *xmfget(darr_t mapped, const char *key);
+	str_t xmkey(darr_t mapped, const etype *e);
+
+`xmget` and `xmfget` look up `key` in a mapped table saved with
+`xsave` and `xfsave` respectively, and `xmkey` returns the key string
+of an element of a mapped table (e.g. one found with `forhash`): the
+`key` field of the element itself holds the offset, not a pointer.
+`xmmap` checks that the file is as long as its header says.
+
+*/
+
+/** A lookup of a key that is not in a table probes until it reaches
+an empty slot, comparing keys on the way, and in a full table that can
+take several cache misses and `strcmp` calls.  When most lookups are
+for absent keys (e.g. out of vocabulary words in a test set), a Bloom
+filter can reject them first:
+
+	dbloom_t bloom_new(size_t n);
+	void bloom_add(dbloom_t b, uint64_t hv);
+	bool bloom_has(dbloom_t b, uint64_t hv);
+	void bloom_free(dbloom_t b);
+
+`bloom_new(n)` creates a filter for `n` keys with at least
+`D_BLOOMBITS` (default 10) bits per key, `bloom_add` adds a hash value
+to it, and `bloom_has` returns `false` if the hash value was never
+added, or `true` if it was (or, for about 1% of the others at 10 bits
+per key, by mistake).  The filter is split into 64-byte blocks (one
+cache line), and a hash value sets one bit in each of the 8 words of
+one block, so `bloom_has` costs a single cache miss.  `D_HASH` also
+defines:
+
+	dbloom_t xbloom(darr_t htable);
+	etype *xbget(darr_t htable, dbloom_t b, ktype key);
+
+`xbloom` returns a filter of the `khash` values of the keys in the
+table, and `xbget(h, b, k)` is `xget(h, k, false)` that returns `NULL`
+without probing the table if `b` rejects `k`.  Keys added to the table
+later should also be added with `bloom_add(b, khash(key))`.  The
+symbol table can keep a filter of its own (see `symtable_bloom`).
+
+*/
+
+#ifndef D_BLOOMBITS
+#define D_BLOOMBITS 10
+#endif
+
+/* A filter has mask + 1 blocks of 8 words at a 64-byte aligned
+   address blk; mem is the pointer to free.  The block comes from the
+   high bits of d_mix64(hv), and the 8 bit positions from 6-bit pieces
+   of another mix, so that the bits are independent of the low bits of
+   hv that a table uses to pick a slot. */
+
+typedef struct dbloom_s { uint64_t *blk; size_t mask; void *mem; } *dbloom_t;
+extern dbloom_t bloom_new(size_t n);
+extern void bloom_free(dbloom_t b);
+
+static inline uint64_t *_d_bloomblk(dbloom_t b, uint64_t hv, uint64_t *x) {
+  uint64_t m = d_mix64(hv);
+  *x = d_mix64(m ^ 0x9E3779B97F4A7C15ULL);
+  return &b->blk[8 * ((m >> 32) & b->mask)];
+}
+
+static inline void bloom_add(dbloom_t b, uint64_t hv) {
+  uint64_t x, *w = _d_bloomblk(b, hv, &x);
+  for (int i = 0; i < 8; i++) w[i] |= 1ULL << ((x >> (6 * i)) & 63);
+}
+
+static inline bool bloom_has(dbloom_t b, uint64_t hv) {
+  uint64_t x, *w = _d_bloomblk(b, hv, &x), miss = 0;
+  for (int i = 0; i < 8; i++) miss |= ~w[i] & (1ULL << ((x >> (6 * i)) & 63));
+  return (miss == 0);
+}
 
 /** Here is an example hash table for counting strings:
 
@@ -524,25 +1285,1320 @@ And print the counts:
 #define d_mkzero(a) ((a)=0)
 #define d_ident(a) (a)
 extern size_t fnv1a(const char *k);
+extern size_t wyhash(const void *p, size_t n, uint64_t seed);
+extern size_t strhash(const char *k);
+
+/** dlib provides two hash functions for strings.  `fnv1a(s)` is
+simple but processes one byte per multiplication, and its low bits
+(the ones used to pick a slot) are not well mixed for short keys.
+`wyhash(p, n, seed)` hashes the `n` bytes at `p` eight bytes at a time
+and mixes all bits well.  `strhash(s)` is `wyhash(s, strlen(s), 0)`
+and can be used as the `khash` argument of `D_HASH` instead of
+`fnv1a`.  To hash a sequence of spans (e.g. the words of an n-gram)
+without copying them into one string, pass the hash of the previous
+spans as the seed of the next:
+
+	size_t h = 0;
+	for (int i = 0; i < n; i++) h = wyhash(w[i], strlen(w[i]), h);
+
+`D_STRHASH(x, etype, einit)` defines a hash table of elements with a
+string `key` field, and `D_STRSET(x)` a set of strings (copied with
+`dstrdup`).  They use the hash function `D_STRHASHFN`, which is
+`strhash` unless defined otherwise before including `dlib.h`.
+
+*/
+
+#ifndef D_STRHASHFN
+#define D_STRHASHFN strhash
+#endif
 
-/* These use the old interface
 #define D_STRHASH(h, etype, einit) \
-  D_HASH(h, etype, str_t, d_keyof, d_strmatch, fnv1a, einit, d_keyisnull, d_keymknull)
+  _D_HASH_LOAD(h, etype, str_t, d_keyof, d_strmatch, D_STRHASHFN, einit, d_keyisnull, d_keymknull, D_HLOAD) \
+  _D_HASH_IO(h, etype, offsetof(etype, key))				\
+  _D_HASH_STRIO(h, etype, offsetof(etype, key), D_STRHASHFN)
 
 #define D_STRSET(h) \
-  D_HASH(h, str_t, str_t, d_ident, d_strmatch, fnv1a, dstrdup, d_isnull, d_mknull)
+  _D_HASH_LOAD(h, str_t, str_t, d_ident, d_strmatch, D_STRHASHFN, dstrdup, d_isnull, d_mknull, D_HLOAD) \
+  _D_HASH_IO(h, str_t, 0)						\
+  _D_HASH_STRIO(h, str_t, 0, D_STRHASHFN)
+
+/* The lookups of mapped string tables follow the probe sequences of
+   xhidx and xfget, resolving each key through the blob. */
+
+#define _D_HASH_STRIO(_pre, _etype, _koff, _khash)			\
+  static inline str_t _pre##mkey(darr_t m, const _etype *e) {		\
+    uintptr_t o = *(const uintptr_t *) (((const char *) e) + (_koff));	\
+    return (o == 0) ? NULL : (str_t) (_d_mblob(m) + o);			\
+  }									\
+									\
+  static inline _etype *_pre##mget(darr_t m, const char *k) {		\
+    if (len(m) == 0) return NULL;					\
+    _etype *d = (_etype *) (m->data);					\
+    size_t mask = cap(m) - 1;						\
+    bool small = (mask < D_HMIN);					\
+    size_t i = small ? 0 : (_khash(k) & mask);				\
+    for (size_t step = 0; i <= mask; ) {				\
+      str_t s = _pre##mkey(m, &d[i]);					\
+      if (s == NULL) return NULL;					\
+      if (!strcmp(k, s)) return &d[i];					\
+      i = small ? (i + 1) : ((i + (++step)) & mask);			\
+    }									\
+    return NULL;							\
+  }									\
+									\
+  static inline _etype *_pre##mfget(darr_t f, const char *k) {		\
+    size_t n = len(f);							\
+    if (n == 0) return NULL;						\
+    size_t hv = _khash(k);						\
+    uint32_t *disp = _d_mphdisp(f, sizeof(_etype));			\
+    size_t m = n - disp[cap(f)];					\
+    _etype *e = (_etype *) (f->data);					\
+    size_t i = _d_mphpos(hv, disp[_d_mphbucket(hv, cap(f))], m);	\
+    for (size_t j = m; ; i = j++) {					\
+      str_t s = _pre##mkey(f, &e[i]);					\
+      if ((s != NULL) && !strcmp(k, s)) return &e[i];			\
+      if (j == n) return NULL;						\
+    }									\
+  }									\
+
+/** `D_TAGHASH` takes the same nine arguments as `D_HASH` and defines
+an `xget` with the same interface, but uses a different table layout.
+Next to the element array it keeps one control byte per slot that
+holds 7 bits of the key's hash (or a special value for an empty
+slot).  A lookup scans these tags 16 slots at a time (with SSE2 if
+available) and calls `kmatch` only for slots whose tag matches.  This
+saves most of the key comparisons (e.g. `strcmp` calls) that `D_HASH`
+performs while probing, and keeps the probes within a few cache
+lines.  A table used with `D_TAGHASH` is still created with `darr` and
+freed with `darr_free`, and can be iterated with `forhash`, but it
+should not be mixed with a `D_HASH` generated `get`.  The top 7 bits
+of `khash` are used for the tags so the hash function should mix its
+high bits well (`fnv1a` does, `d_ident` on small integers does not).
+
+	D_TAGHASH(s, strcnt_t, char *, keyof, strmatch, fnv1a, newcnt, keyisnull, keymknull)
+
 */
 
+/* The control bytes of a table with capacity c follow its c elements
+   in the same memory block.  Tags are scanned in aligned groups of
+   _D_GROUP, so the capacity of a tagged table is at least _D_GROUP.
+   There is no deletion so there are no tombstones: a probe sequence
+   ends at the first group that has an empty slot. */
+
+#define _D_GROUP 16
+#define _D_TAGEMPTY 0x80
+#define _d_tag(hv) ((uint8_t)((hv) >> 57))
+
+static inline unsigned _d_tagmatch(const uint8_t *g, uint8_t t) {
+#ifdef __SSE2__
+  __m128i x = _mm_loadu_si128((const __m128i *) g);
+  return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8((char) t)));
+#else
+  unsigned m = 0;
+  for (unsigned i = 0; i < _D_GROUP; i++) m |= ((unsigned) (g[i] == t)) << i;
+  return m;
+#endif
+}
+
+static inline unsigned _d_ctz(uint64_t x) {
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  unsigned n = 0;
+  while (!(x & 1)) { x >>= 1; n++; }
+  return n;
+#endif
+}
+
+#define D_TAGHASH(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull) \
+									\
+  static inline uint8_t *_pre##tags(darr_t h) {				\
+    return ((uint8_t *) (h->data)) + cap(h) * sizeof(_etype);		\
+  }									\
+									\
+  static inline void _pre##init(darr_t h) {				\
+    while (cap(h) < _D_GROUP) _d_dblcap(h);				\
+    size_t c = cap(h);							\
+    h->data = _d_realloc(h->data, c * (sizeof(_etype) + 1));		\
+    _etype *d = (_etype *) (h->data);					\
+    for (size_t i = 0; i < c; _mknull(d[i++]));				\
+    memset(_pre##tags(h), _D_TAGEMPTY, c);				\
+  }									\
+									\
+  static inline size_t _pre##idx(darr_t h, _ktype k, size_t hv) {	\
+    size_t gmask = (cap(h) / _D_GROUP) - 1;				\
+    _etype *data = (_etype *) h->data;					\
+    uint8_t *tags = _pre##tags(h);					\
+    uint8_t t = _d_tag(hv);						\
+    for (size_t g = (hv & gmask), step = 0; ;				\
+	 step++, g = ((g + step) & gmask)) {				\
+      uint8_t *gt = &tags[g * _D_GROUP];				\
+      for (unsigned m = _d_tagmatch(gt, t); m != 0; m &= m - 1) {	\
+	size_t i = g * _D_GROUP + _d_ctz(m);				\
+	if (_kmatch(k, _keyof(data[i]))) return i;			\
+      }									\
+      unsigned e = _d_tagmatch(gt, _D_TAGEMPTY);			\
+      if (e != 0) return g * _D_GROUP + _d_ctz(e);			\
+    }									\
+  }									\
+									\
+  static inline void _pre##resize(darr_t h) {				\
+    size_t c1 = cap(h);							\
+    _etype *d1 = (_etype *) (h->data);					\
+    uint8_t *t1 = _pre##tags(h);					\
+    _d_dblcap(h);							\
+    size_t c2 = cap(h);							\
+    h->data = _d_malloc(c2 * (sizeof(_etype) + 1));			\
+    _etype *d2 = (_etype *) (h->data);					\
+    uint8_t *t2 = _pre##tags(h);					\
+    size_t gmask = (c2 / _D_GROUP) - 1;					\
+    for (size_t i2 = 0; i2 < c2; _mknull(d2[i2++]));			\
+    memset(t2, _D_TAGEMPTY, c2);					\
+    for (size_t i1 = 0; i1 < c1; i1++) {				\
+      if (t1[i1] == _D_TAGEMPTY) continue;				\
+      size_t hv = _khash(_keyof(d1[i1]));				\
+      size_t g = (hv & gmask), step = 0;				\
+      unsigned e;							\
+      while ((e = _d_tagmatch(&t2[g * _D_GROUP], _D_TAGEMPTY)) == 0)	\
+	g = ((g + (++step)) & gmask);					\
+      size_t i2 = g * _D_GROUP + _d_ctz(e);				\
+      d2[i2] = d1[i1];							\
+      t2[i2] = t1[i1];							\
+    }									\
+    _d_free(d1);							\
+  }									\
+									\
+  static inline _etype *_pre##get(darr_t h, _ktype k, bool insert) {	\
+    if (len(h) == 0) {							\
+      if (!insert) return NULL;						\
+      _pre##init(h);							\
+    }									\
+    size_t hv = _khash(k);						\
+    size_t idx = _pre##idx(h, k, hv);					\
+    if (_pre##tags(h)[idx] == _D_TAGEMPTY) {				\
+      if (!insert) return NULL;						\
+      size_t c = cap(h);						\
+      if (len(h) >= _d_hmax(c, D_HLOAD)) {				\
+	_pre##resize(h);						\
+	idx = _pre##idx(h, k, hv);					\
+      }									\
+      ((_etype *) (h->data))[idx] = _einit(k);				\
+      _pre##tags(h)[idx] = _d_tag(hv);					\
+      _d_inclen(h);							\
+    }									\
+    return &((_etype *) (h->data))[idx];				\
+  }									\
+
+
+/** `D_IHASH` also takes the same nine arguments as `D_HASH` and
+defines an `xget` with the same interface, but it resizes the table
+incrementally.  When a `D_HASH` table grows, the `xget` call that
+triggers the resize rehashes every element in one go, which stalls the
+program for seconds on tables with hundreds of millions of entries.
+When a `D_IHASH` table grows, the old array is kept next to the new one
+and each subsequent `xget` with `insert == true` moves the next
+`D_ISTEP` (default 16) slots of the old array into the new one.
+Lookups check the new array first and then the old one until the move
+is done, so the pointer returned by `xget` may point into either.  The
+`D_IHASH` macro also defines:
+
+	void xfinish(darr_t htable);
+
+which completes any move in progress.  Call `xfinish` before
+iterating over the table with `forhash` or freeing it with
+`darr_free`, because these only see the new array.
+
+*/
+
+#ifndef D_ISTEP
+#define D_ISTEP 16
+#endif
+
+/* The resize state of a D_IHASH table is kept in a trailer after its
+   elements in the same memory block.  Moved elements are not removed
+   from the old array so that probe sequences through it stay intact;
+   they are found in the new array first.  The new array is allocated
+   with calloc if an all-zero element is null (e.g. a NULL key), so
+   that the pages it does not use yet are never touched; otherwise it
+   has to be nulled when it is allocated.  The moves and allocations
+   are kept out of line (see _d_noinline) so that xget stays small. */
+
+struct _d_ihash_s { ptr_t old; size_t oldcap; size_t next; };
+#define _d_ihash(h, esize) ((struct _d_ihash_s *) (((char *) ((h)->data)) + _D_ALIGN(cap(h) * (esize))))
+
+#define D_IHASH(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull) \
+									\
+  static inline size_t _pre##idx(_etype *data, size_t mask, _ktype k) {	\
+    size_t idx, step;							\
+    for (idx = (_khash(k) & mask), step = 0;				\
+	 (!_isnull(data[idx]) &&					\
+	  !_kmatch(k, _keyof(data[idx])));				\
+	 step++, idx = ((idx+step) & mask));				\
+    return idx;								\
+  }									\
+									\
+  static _d_noinline void _pre##alloc(darr_t h, ptr_t old, size_t oldcap) { \
+    size_t c = cap(h);							\
+    size_t n = _D_ALIGN(c * sizeof(_etype)) + sizeof(struct _d_ihash_s); \
+    _etype z;								\
+    memset(&z, 0, sizeof(_etype));					\
+    if (_isnull(z)) {							\
+      h->data = _d_calloc(1, n);					\
+    } else {								\
+      h->data = _d_malloc(n);						\
+      _etype *d = (_etype *) (h->data);					\
+      for (size_t i = 0; i < c; _mknull(d[i++]));			\
+    }									\
+    struct _d_ihash_s *t = _d_ihash(h, sizeof(_etype));			\
+    t->old = old; t->oldcap = oldcap; t->next = 0;			\
+  }									\
+									\
+  static _d_noinline void _pre##move(darr_t h, size_t n) {		\
+    struct _d_ihash_s *t = _d_ihash(h, sizeof(_etype));			\
+    _etype *d1 = (_etype *) (t->old);					\
+    _etype *d2 = (_etype *) (h->data);					\
+    size_t mask = cap(h) - 1;						\
+    size_t end = ((t->oldcap - t->next) > n) ? t->next + n : t->oldcap;	\
+    for (size_t i1 = t->next; i1 < end; i1++) {				\
+      if (_isnull(d1[i1])) continue;					\
+      d2[_pre##idx(d2, mask, _keyof(d1[i1]))] = d1[i1];			\
+    }									\
+    t->next = end;							\
+    if (end == t->oldcap) {						\
+      _d_free(t->old);							\
+      t->old = NULL;							\
+    }									\
+  }									\
+									\
+  static inline void _pre##step(darr_t h, size_t n) {			\
+    if (_d_ihash(h, sizeof(_etype))->old != NULL) _pre##move(h, n);	\
+  }									\
+									\
+  static inline void _pre##finish(darr_t h) {				\
+    if (len(h) == 0) return;						\
+    _pre##step(h, _d_ihash(h, sizeof(_etype))->oldcap);			\
+  }									\
+									\
+  static inline _etype *_pre##get(darr_t h, _ktype k, bool insert) {	\
+    if (len(h) == 0) {							\
+      if (!insert) return NULL;						\
+      _d_free(h->data);							\
+      _pre##alloc(h, NULL, 0);						\
+    } else if (insert) {						\
+      _pre##step(h, D_ISTEP);						\
+    }									\
+    size_t c = cap(h);							\
+    _etype *d = (_etype *) (h->data);					\
+    size_t idx = _pre##idx(d, c - 1, k);				\
+    if (!_isnull(d[idx])) return &d[idx];				\
+    struct _d_ihash_s *t = _d_ihash(h, sizeof(_etype));			\
+    if (t->old != NULL) {						\
+      _etype *d1 = (_etype *) (t->old);					\
+      size_t i1 = _pre##idx(d1, t->oldcap - 1, k);			\
+      if (!_isnull(d1[i1])) return &d1[i1];				\
+    }									\
+    if (!insert) return NULL;						\
+    if (len(h) >= _d_hmax(c, D_HLOAD)) {				\
+      _pre##finish(h);							\
+      _d_dblcap(h);							\
+      _pre##alloc(h, d, c);						\
+      _pre##step(h, D_ISTEP);						\
+      c = cap(h);							\
+      d = (_etype *) (h->data);						\
+      idx = _pre##idx(d, c - 1, k);					\
+    }									\
+    d[idx] = _einit(k);							\
+    _d_inclen(h);							\
+    return &d[idx];							\
+  }									\
+
+/** `D_HASH` tables are not safe to use from multiple threads.  `D_CHASH`
+takes the same nine arguments as `D_HASH` and defines functions for a
+table type `dchash_t` that many threads can share:
+
+	dchash_t xnew(size_t n);
+	void xlock(dchash_t htable);
+	void xunlock(dchash_t htable);
+	etype *xget(dchash_t htable, ktype key, bool insert);
+
+`xnew` creates a table with an initial capacity of at least `n` and
+`dchash_free` frees it.  A thread calls `xlock` before a group of
+`xget` calls (e.g. for each line) and `xunlock` after them.  `xget`
+works as before, lookups and inserts by different threads proceed in
+parallel without blocking each other.  When the table needs to grow,
+the thread that notices releases its lock and waits for the others to
+reach `xunlock`, then resizes the table (with `dthreads` threads if it
+is large).  So a pointer returned by `xget` stays valid only until the
+next `xget` or `xunlock` of the same thread, and it should be updated
+with atomic operations if other threads can update the same element.
+`datomic_add(x, d)` and `datomic_inc(x)` atomically add to an integer
+l-value.  `einit` and `khash` should be safe to call from multiple
+threads (e.g. use `strdup` rather than `dstrdup`).  `forchash(etype,
+eptr, htable, isnull)` iterates over the elements when no other
+thread is using the table.  Here is the word count example for
+multiple threads, each reading its own part of the input:
+
+	D_CHASH(p, strcnt_t, char *, keyof, strmatch, fnv1a, newcnt, keyisnull, keymknull)
+	dchash_t htable = pnew(0);
+
+	// in each thread:
+	forline (str, fname) {
+	  plock(htable);
+	  fortok (tok, str) {
+	    datomic_inc(pget(htable, tok, true)->cnt);
+	  }
+	  punlock(htable);
+	}
+
+Without pthreads (`_NO_PTHREAD`) the locks and atomic operations turn
+into no-ops.
+
+*/
+
+/* The elements of a dchash_t are followed by one state byte per slot
+   in the same memory block: 0 for empty, 1 for an element being
+   written and 2 for a full slot.  An inserting thread claims an empty
+   slot by changing its state from 0 to 1, and publishes the element by
+   setting the state to 2.  Resizes happen under the write lock, which
+   is allocated by _d_dchash so that this header does not depend on
+   the pthread rwlock type. */
+
+typedef struct dchash_s {
+  struct darr_s a;
+  void *lock;
+} *dchash_t;
+
+extern dchash_t _d_dchash(size_t nmemb, size_t esize);
+extern void dchash_free(dchash_t h);
+extern void _d_rdlock(dchash_t h);
+extern void _d_wrlock(dchash_t h);
+extern void _d_unlock(dchash_t h);
+
+#define _D_CEMPTY 0
+#define _D_CBUSY 1
+#define _D_CFULL 2
+
+#define forchash(_etype, _e, _h, _isnull) forhash(_etype, _e, &((_h)->a), _isnull)
+
+#define D_CHASH(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull) \
+									\
+  typedef struct { _etype *d1, *d2; uint8_t *s1, *s2; size_t c1, c2; } _pre##cargs_t; \
+									\
+  static inline void _pre##cfill(void *arg, size_t tid, size_t n) {	\
+    _pre##cargs_t *a = (_pre##cargs_t *) arg;				\
+    size_t beg = a->c2 / n * tid;					\
+    size_t end = (tid == n - 1) ? a->c2 : a->c2 / n * (tid + 1);	\
+    for (size_t i2 = beg; i2 < end; _mknull(a->d2[i2++]));		\
+    memset(&a->s2[beg], _D_CEMPTY, end - beg);				\
+  }									\
+									\
+  static inline void _pre##cmove(void *arg, size_t tid, size_t n) {	\
+    _pre##cargs_t *a = (_pre##cargs_t *) arg;				\
+    size_t mask = a->c2 - 1;						\
+    size_t end = (tid == n - 1) ? a->c1 : a->c1 / n * (tid + 1);	\
+    for (size_t i1 = a->c1 / n * tid; i1 < end; i1++) {		\
+      if (a->s1[i1] != _D_CFULL) continue;				\
+      size_t idx = (_khash(_keyof(a->d1[i1])) & mask), step = 0;	\
+      while (!_d_cas(&a->s2[idx], _D_CEMPTY, _D_CFULL))			\
+	idx = ((idx + (++step)) & mask);				\
+      a->d2[idx] = a->d1[i1];						\
+    }									\
+  }									\
+									\
+  static inline dchash_t _pre##new(size_t n) {				\
+    dchash_t h = _d_dchash(n, sizeof(_etype));				\
+    _etype *d = (_etype *) (h->a.data);					\
+    for (size_t i = 0, c = cap(&h->a); i < c; _mknull(d[i++]));		\
+    return h;								\
+  }									\
+									\
+  static inline void _pre##lock(dchash_t h) { _d_rdlock(h); }		\
+  static inline void _pre##unlock(dchash_t h) { _d_unlock(h); }	\
+									\
+  static inline void _pre##resize(dchash_t h) {			\
+    size_t c = cap(&h->a);						\
+    if (len(&h->a) < _d_hmax(c, D_HLOAD)) return;			\
+    _pre##cargs_t a;							\
+    a.c1 = c; a.d1 = (_etype *) (h->a.data);				\
+    a.s1 = (uint8_t *) (a.d1 + c);					\
+    _d_dblcap(&h->a);							\
+    a.c2 = cap(&h->a);							\
+    h->a.data = _d_malloc(a.c2 * (sizeof(_etype) + 1));		\
+    a.d2 = (_etype *) (h->a.data);					\
+    a.s2 = (uint8_t *) (a.d2 + a.c2);					\
+    if (a.c1 < D_PMIN) {						\
+      _pre##cfill(&a, 0, 1);						\
+      _pre##cmove(&a, 0, 1);						\
+    } else {								\
+      _d_parallel(_pre##cfill, &a);					\
+      _d_parallel(_pre##cmove, &a);					\
+    }									\
+    _d_free(a.d1);							\
+  }									\
+									\
+  static inline _etype *_pre##get(dchash_t h, _ktype k, bool insert) {	\
+    size_t hv = _khash(k);						\
+    for (;;) {								\
+      size_t c = 1ULL << (_d_load(&h->a.bits) >> _D_LENBITS);		\
+      size_t mask = c - 1;						\
+      _etype *d = (_etype *) (h->a.data);				\
+      uint8_t *st = (uint8_t *) (d + c);				\
+      for (size_t idx = (hv & mask), step = 0; ;			\
+	   step++, idx = ((idx + step) & mask)) {			\
+	uint8_t s = _d_load(&st[idx]);					\
+	if (s == _D_CEMPTY) {						\
+	  if (!insert) return NULL;					\
+	  uint64_t l = _d_xadd(&h->a.bits, 1) & ((1ULL << _D_LENBITS) - 1); \
+	  if (l >= _d_hmax(c, D_HLOAD)) {				\
+	    (void) _d_xadd(&h->a.bits, (uint64_t) -1);			\
+	    break;							\
+	  }								\
+	  if (_d_cas(&st[idx], _D_CEMPTY, _D_CBUSY)) {			\
+	    d[idx] = _einit(k);						\
+	    _d_store(&st[idx], _D_CFULL);				\
+	    return &d[idx];						\
+	  }								\
+	  (void) _d_xadd(&h->a.bits, (uint64_t) -1);			\
+	  s = _d_load(&st[idx]);					\
+	}								\
+	while (s == _D_CBUSY) s = _d_load(&st[idx]);			\
+	if (_kmatch(k, _keyof(d[idx]))) return &d[idx];			\
+      }									\
+      _d_unlock(h);							\
+      _d_wrlock(h);							\
+      _pre##resize(h);							\
+      _d_unlock(h);							\
+      _d_rdlock(h);							\
+    }									\
+  }									\
+
+
+/** A memo table that keeps every key it is asked about grows without
+bound.  `D_CACHE` takes the nine arguments of `D_HASH` and a tenth,
+`efree`, and defines a cache of a fixed number of elements:
+
+	darr_t xnew(size_t n);
+	etype *xget(darr_t cache, ktype key, bool insert);
+	bool xdel(darr_t cache, ktype key);
+	void xfree(darr_t cache);
+
+`xnew(n)` creates a cache that holds at least `n` elements.  `xget`
+works like the `D_HASH` one, except that inserting into a full cache
+first evicts an element, chosen with the CLOCK algorithm: each slot
+has a reference byte that `xget` sets when it finds the key, and a
+clock hand sweeps the slots, clearing set bytes and evicting the first
+element whose byte is clear.  So keys that are looked up again
+survive and keys seen once are evicted after about one sweep (new
+elements start with a clear byte).  `xdel` removes `key` and returns
+`true` if it was in the cache.  `void efree(etype e)` is called on
+every element that is evicted or deleted (e.g. to free a copied key
+or value), and on the remaining elements by `xfree`, which also frees
+the cache.  Use `d_nofree` if there is nothing to free.  The table
+uses linear probing, is at most `D_CLOAD`/16 (default 8/16) full and
+never grows.  The reference bytes and the hand are kept after the
+element array and nothing is allocated per element, so a hit costs
+about as much as a `D_HASH` lookup.  Evicting or deleting an element
+moves other elements, so a pointer returned by `xget` is invalid after
+the next insert or `xdel`.  The cache can be iterated with `forhash`
+and its keys should be well mixed by `khash`.
+
+	D_CACHE(m, memo_t, char *, d_keyof, d_strmatch, strhash, newmemo, d_keyisnull, d_keymknull, freememo)
+	darr_t memo = mnew(100000);
+	memo_t *e = mget(memo, str, true);
+	if (e->val == NULL) e->val = compute(str);
+
+*/
+
+/* The c slots of a cache are followed by c reference bytes and the
+   position of the clock hand, and hold at most _d_hmax(c, D_CLOAD)
+   elements.  Linear probing needs a lower load factor than the
+   quadratic probing of D_HASH to keep probe runs short.  Deleting an
+   element shifts back the later elements of its probe run whose home
+   slots are not between the hole and their slots (with their
+   reference bytes), so there are no tombstones. */
+
+#ifndef D_CLOAD
+#define D_CLOAD 8
+#endif
+
+#define d_nofree(e) ((void) 0)
+
+#define D_CACHE(_pre, _etype, _ktype, _keyof, _kmatch, _khash, _einit, _isnull, _mknull, _efree) \
+									\
+  static inline uint8_t *_pre##refs(darr_t c) {				\
+    return ((uint8_t *) (c->data)) + cap(c) * sizeof(_etype);		\
+  }									\
+									\
+  static inline size_t *_pre##hand(darr_t c) {				\
+    return (size_t *) (((char *) (c->data)) + _D_ALIGN(cap(c) * (sizeof(_etype) + 1))); \
+  }									\
+									\
+  static inline darr_t _pre##new(size_t n) {				\
+    darr_t c = _d_malloc(sizeof(struct darr_s));			\
+    size_t b = _d_hbits(n, D_CLOAD), m = 1ULL << b;			\
+    c->bits = 0;							\
+    c->data = _d_malloc(_D_ALIGN(m * (sizeof(_etype) + 1)) + sizeof(size_t)); \
+    _d_setcapbits(c, b);						\
+    _etype *d = (_etype *) (c->data);					\
+    for (size_t i = 0; i < m; _mknull(d[i++]));				\
+    memset(_pre##refs(c), 0, m);					\
+    *_pre##hand(c) = 0;							\
+    return c;								\
+  }									\
+									\
+  static inline size_t _pre##idx(darr_t c, _ktype k) {			\
+    size_t mask = cap(c) - 1;						\
+    _etype *d = (_etype *) (c->data);					\
+    size_t i = _khash(k) & mask;					\
+    while (!_isnull(d[i]) && !_kmatch(k, _keyof(d[i])))			\
+      i = (i + 1) & mask;						\
+    return i;								\
+  }									\
+									\
+  static inline void _pre##delidx(darr_t c, size_t i) {			\
+    size_t mask = cap(c) - 1;						\
+    _etype *d = (_etype *) (c->data);					\
+    uint8_t *r = _pre##refs(c);						\
+    _efree(d[i]);							\
+    for (size_t j = (i + 1) & mask; !_isnull(d[j]); j = (j + 1) & mask) { \
+      size_t home = _khash(_keyof(d[j])) & mask;			\
+      if (((j - home) & mask) < ((j - i) & mask)) continue;		\
+      d[i] = d[j]; r[i] = r[j]; i = j;					\
+    }									\
+    _mknull(d[i]); r[i] = 0;						\
+    _d_setlen(c, len(c) - 1);						\
+  }									\
+									\
+  static inline void _pre##evict(darr_t c) {				\
+    size_t mask = cap(c) - 1, *hand = _pre##hand(c);			\
+    _etype *d = (_etype *) (c->data);					\
+    uint8_t *r = _pre##refs(c);						\
+    for (size_t i = *hand; ; i = (i + 1) & mask) {			\
+      if (_isnull(d[i])) continue;					\
+      if (r[i]) { r[i] = 0; continue; }					\
+      _pre##delidx(c, i);						\
+      *hand = i;							\
+      return;								\
+    }									\
+  }									\
+									\
+  static inline _etype *_pre##get(darr_t c, _ktype k, bool insert) {	\
+    size_t i = _pre##idx(c, k);						\
+    _etype *d = (_etype *) (c->data);					\
+    uint8_t *r = _pre##refs(c);						\
+    if (!_isnull(d[i])) {						\
+      if (!r[i]) r[i] = 1;						\
+      return &d[i];							\
+    }									\
+    if (!insert) return NULL;						\
+    if (len(c) >= _d_hmax(cap(c), D_CLOAD)) {				\
+      _pre##evict(c);							\
+      i = _pre##idx(c, k);						\
+    }									\
+    d[i] = _einit(k);							\
+    _d_inclen(c);							\
+    return &d[i];							\
+  }									\
+									\
+  static inline bool _pre##del(darr_t c, _ktype k) {			\
+    size_t i = _pre##idx(c, k);						\
+    if (_isnull(((_etype *) (c->data))[i])) return false;		\
+    _pre##delidx(c, i);							\
+    return true;							\
+  }									\
+									\
+  static inline void _pre##free(darr_t c) {				\
+    forhash (_etype, _e, c, _isnull) _efree(*_e);			\
+    darr_free(c);							\
+  }									\
+
+
 /* symbol table: symbols are represented with uint32_t > 0.  str2sym
    returns 0 for strings not found if create=false.  sym2str returns
-   NULL if sym is 0 or out of range. 
-   TODO: this is not thread-safe, keep symtable in a variable!
+   NULL if sym is 0 or out of range.  Strings are hashed with
+   D_SYMHASH, which is strhash unless dlib.c is compiled with
+   e.g. -DD_SYMHASH=fnv1a.  symtable_freeze replaces the hash table
+   with a frozen one (see xfreeze) once all symbols are created;
+   creating a new symbol after that rebuilds the hash table.
+   symtable_save writes the strings and the hash table to a file and
+   symtable_load replaces the symbol table with the one in the file by
+   mapping it into memory (see darr_mmap), so the same strings get
+   the same sym_t in every program that loads it.  Loading copies and
+   hashes no strings, so it is instant even for a large vocabulary.
+   The file should be loaded by a program compiled with the same
+   D_SYMHASH.  symtable_save thaws a frozen table.
+
+   These functions use a default symbol table.  Independent tables
+   of type symtab_t are created with symtab_new and used with the
+   symtab_ functions that take the table as their first argument.
+   str2sym and sym2str can be called from multiple threads: lookups
+   of existing symbols take no lock, and new symbols lock one of 64
+   shards of the table.  Symbols are numbered in the order they are
+   created, which depends on the order of the threads.  symtab_free,
+   symtab_freeze, symtab_save and creating a symbol in a frozen table
+   should not run concurrently with other calls on the same table.
+
+   symtable_renumber(keys, drop) renumbers the symbols in decreasing
+   order of val(keys, sym, size_t) (e.g. their counts; ties keep their
+   old order), so that frequent symbols get small ids and their
+   strings are stored together.  keys should have at least one more
+   element than there are symbols (it dies otherwise).  If drop is
+   true, symbols with a key of 0 are removed.  It returns a darr_t of
+   sym_t that maps each old sym to its new one (or 0 if dropped).
+   sym_remap(a, n, map) applies it to an array of n sym_t (and dies on
+   a symbol that is not in the map), and tables keyed by sym_t can be
+   updated with forhash and xrekey.  The old ids, and strings returned
+   by sym2str before the call, are invalid after it.
+
+   symtable_compress() converts the symbol table to a compressed
+   read-only form for very large vocabularies: the strings are sorted
+   and front coded (each string stores only what it does not share
+   with the previous one) in blocks of 16, and two arrays map symbols
+   to sorted positions and back.  This takes 8 bytes per symbol plus
+   the compressed strings, instead of about 24 bytes plus a copy of
+   each string.  sym2str decodes the block of the symbol the first
+   time one of its strings is asked for and keeps it until the table
+   is expanded or freed, so that the strings it returns stay valid
+   until then, and only the blocks in use take memory.  str2sym uses
+   a binary search and scans one block without decoding it.  Creating
+   a new symbol (or calling symtable_renumber or symtable_save)
+   expands the table back to its normal form first.  Compressing and
+   expanding should not run concurrently with other calls on the same
+   table.
+
+   symtable_bloom() attaches a Bloom filter (see bloom_new) of the
+   current symbols to the symbol table, so that str2sym(str, false)
+   returns 0 for most strings that are not symbols without searching
+   the table.  New symbols are added to the filter as they are
+   created, but its false positive rate grows past the size it was
+   built for; calling symtable_bloom again rebuilds it.  The filter is
+   kept when the table is compressed, expanded or renumbered (symbols
+   dropped by renumbering stay in it as false positives), and dropped
+   when it is loaded.  symtable_bloom should not run concurrently with
+   other calls on the same table.
 */
 
 typedef uint32_t sym_t;
+typedef struct symtab_s *symtab_t;
 extern sym_t str2sym(const str_t str, bool create);
 extern str_t sym2str(sym_t sym);
 extern void symtable_free();
+extern void symtable_freeze();
+extern void symtable_compress();
+extern void symtable_bloom();
+extern void symtable_save(const char *path);
+extern void symtable_load(const char *path);
+extern symtab_t symtab_new();
+extern void symtab_free(symtab_t t);
+extern sym_t symtab_str2sym(symtab_t t, const str_t str, bool create);
+extern str_t symtab_sym2str(symtab_t t, sym_t sym);
+extern size_t symtab_len(symtab_t t);
+extern void symtab_freeze(symtab_t t);
+extern void symtab_compress(symtab_t t);
+extern void symtab_bloom(symtab_t t);
+extern void symtab_save(symtab_t t, const char *path);
+extern symtab_t symtab_load(const char *path);
+extern darr_t symtable_renumber(darr_t keys, bool drop);
+extern darr_t symtab_renumber(symtab_t t, darr_t keys, bool drop);
+extern void sym_remap(sym_t *a, size_t n, darr_t map);
+
+/** Tables keyed by symbols (`sym_t`) can use `D_SYMMAP` instead of
+`D_HASH`.  Symbols are small dense integers, so a map from symbols to
+values can simply be an array indexed by the symbol.  `D_SYMMAP(x,
+vtype, vinit)` defines functions for a map type `dsymmap_t` from
+`sym_t` keys to values of type `vtype`:
+
+	dsymmap_t xnew(size_t maxsym);
+	vtype *xget(dsymmap_t map, sym_t key, bool insert);
+
+`xget` works like the `D_HASH` one; new values are initialized with
+`vinit(key)`.  Key 0 is not a symbol and `xget` returns NULL for it.
+A map starts as a small hash table of (key, value) pairs and switches
+to an array of values (with a bitmap of the keys that are present)
+when it grows and holds at least one in `D_SYMDENSE` (default 4) of
+the symbols up to its largest key, and back to a hash table when a
+key beyond the array would make it sparser than that.  So maps with
+a few keys (e.g. the successors of a word) stay small and maps that
+cover most of the vocabulary (e.g. word counts) are looked up without
+any hashing or probing.  `xnew(n)` starts with an array for symbols
+below `n` if `n > 0`.  `len(&map->a)` gives the number of keys,
+`dsymmap_free` frees the map, and
+
+	forsymmap(x, k, vptr, map)
+
+iterates over the keys `size_t k` and value pointers `vtype *vptr` of
+the map.
+
+	D_SYMMAP(c, size_t, d_zero)
+	dsymmap_t cnt = cnew(0);
+	fortok (tok, str) (*cget(cnt, str2sym(tok, true), true))++;
+
+*/
+
+/* A dsymmap_t is dense if its array holds groups of 64 values, each
+   group preceded by a uint64_t with one bit per value that is
+   present.  Otherwise it holds (key, value) pairs with quadratic
+   probing on d_mix64(key) and key 0 for empty slots.  max is the
+   largest key inserted.  The growth paths are kept out of line in
+   grow so that get stays small enough to inline. */
+
+#ifndef D_SYMDENSE
+#define D_SYMDENSE 4
+#endif
+
+#define d_zero(k) 0
+
+typedef struct dsymmap_s {
+  struct darr_s a;
+  size_t max;
+  bool dense;
+} *dsymmap_t;
+
+extern void dsymmap_free(dsymmap_t m);
+
+#define forsymmap(_pre, _k, _v, _m)					\
+  for (size_t _k##_i = 0, _k = 0; _pre##next((_m), &_k##_i, &_k); _k##_i++) \
+    for (_pre##val_t *_v = _pre##at((_m), _k##_i); _v != NULL; _v = NULL)
+
+#define D_SYMMAP(_pre, _vtype, _vinit)					\
+  typedef _vtype _pre##val_t;						\
+  typedef struct { sym_t key; _vtype val; } _pre##pair_t;		\
+  typedef struct { uint64_t bits; _vtype v[64]; } _pre##group_t;	\
+									\
+  static _d_noinline void _pre##todense(dsymmap_t m, size_t maxsym) {	\
+    size_t b = 0;							\
+    while ((64ULL << b) <= maxsym) b++;					\
+    _pre##group_t *g = _d_calloc(1ULL << b, sizeof(_pre##group_t));	\
+    if (m->dense) {							\
+      memcpy(g, m->a.data, cap(&m->a) * sizeof(_pre##group_t));		\
+    } else {								\
+      _pre##pair_t *p = (_pre##pair_t *) (m->a.data);			\
+      for (size_t i = 0, c = cap(&m->a); i < c; i++) {			\
+	sym_t k = p[i].key;						\
+	if (k == 0) continue;						\
+	g[k >> 6].bits |= (1ULL << (k & 63));				\
+	g[k >> 6].v[k & 63] = p[i].val;					\
+      }									\
+    }									\
+    _d_free(m->a.data);							\
+    m->a.data = g;							\
+    _d_setcapbits(&m->a, b);						\
+    m->dense = true;							\
+  }									\
+									\
+  static _d_noinline dsymmap_t _pre##new(size_t maxsym) {		\
+    dsymmap_t m = _d_calloc(1, sizeof(struct dsymmap_s));		\
+    m->a.data = _d_calloc(2, sizeof(_pre##pair_t));			\
+    _d_setcapbits(&m->a, 1);						\
+    if (maxsym > 0) _pre##todense(m, maxsym - 1);			\
+    return m;								\
+  }									\
+									\
+  static inline size_t _pre##idx(dsymmap_t m, sym_t k) {		\
+    size_t mask = cap(&m->a) - 1;					\
+    _pre##pair_t *p = (_pre##pair_t *) (m->a.data);			\
+    size_t i = d_mix64(k) & mask, step = 0;				\
+    while ((p[i].key != 0) && (p[i].key != k))				\
+      i = (i + (++step)) & mask;					\
+    return i;								\
+  }									\
+									\
+  static _d_noinline void _pre##tosparse(dsymmap_t m) {			\
+    size_t c = cap(&m->a), b = 1;					\
+    while (_d_hmax(1ULL << b, D_HLOAD) <= len(&m->a)) b++;		\
+    _pre##group_t *g = (_pre##group_t *) (m->a.data);			\
+    m->a.data = _d_calloc(1ULL << b, sizeof(_pre##pair_t));		\
+    _d_setcapbits(&m->a, b);						\
+    m->dense = false;							\
+    _pre##pair_t *q = (_pre##pair_t *) (m->a.data);			\
+    for (size_t i = 0; i < c; i++)					\
+      for (uint64_t bits = g[i].bits; bits != 0; bits &= bits - 1) {	\
+	sym_t k = (i << 6) + _d_ctz(bits);				\
+	size_t j = _pre##idx(m, k);					\
+	q[j].key = k;							\
+	q[j].val = g[i].v[k & 63];					\
+      }									\
+    _d_free(g);								\
+  }									\
+									\
+  static _d_noinline void _pre##resize(dsymmap_t m) {			\
+    size_t c = cap(&m->a);						\
+    _pre##pair_t *p = (_pre##pair_t *) (m->a.data);			\
+    m->a.data = _d_calloc(2 * c, sizeof(_pre##pair_t));			\
+    _d_setcapbits(&m->a, _d_capbits(&m->a) + 1);			\
+    _pre##pair_t *q = (_pre##pair_t *) (m->a.data);			\
+    for (size_t i = 0; i < c; i++)					\
+      if (p[i].key != 0) q[_pre##idx(m, p[i].key)] = p[i];		\
+    _d_free(p);								\
+  }									\
+									\
+  static inline _vtype *_pre##get(dsymmap_t m, sym_t k, bool insert);	\
+									\
+  static _d_noinline _vtype *_pre##grow(dsymmap_t m, sym_t k) {		\
+    size_t max = (k > m->max) ? k : m->max;				\
+    bool dense = ((len(&m->a) + 1) * D_SYMDENSE > max);			\
+    if (dense) _pre##todense(m, max);					\
+    else if (m->dense) _pre##tosparse(m);				\
+    else _pre##resize(m);						\
+    return _pre##get(m, k, true);					\
+  }									\
+									\
+  static inline _vtype *_pre##get(dsymmap_t m, sym_t k, bool insert) {	\
+    if (k == 0) return NULL;						\
+    if (!m->dense) {							\
+      _pre##pair_t *p = (_pre##pair_t *) (m->a.data);			\
+      size_t i = _pre##idx(m, k);					\
+      if (p[i].key != 0) return &p[i].val;				\
+      if (!insert) return NULL;						\
+      if (len(&m->a) >= _d_hmax(cap(&m->a), D_HLOAD))			\
+	return _pre##grow(m, k);					\
+      p[i].key = k;							\
+      p[i].val = _vinit(k);						\
+      _d_inclen(&m->a);							\
+      if (k > m->max) m->max = k;					\
+      return &p[i].val;							\
+    }									\
+    size_t g = k >> 6;							\
+    uint64_t b = 1ULL << (k & 63);					\
+    if (g >= cap(&m->a)) return (insert ? _pre##grow(m, k) : NULL);	\
+    _pre##group_t *q = &(((_pre##group_t *) (m->a.data))[g]);		\
+    if (!(q->bits & b)) {						\
+      if (!insert) return NULL;						\
+      q->bits |= b;							\
+      q->v[k & 63] = _vinit(k);						\
+      _d_inclen(&m->a);							\
+      if (k > m->max) m->max = k;					\
+    }									\
+    return &q->v[k & 63];						\
+  }									\
+  static inline bool _pre##next(dsymmap_t m, size_t *i, size_t *k) {	\
+    if (!m->dense) {							\
+      _pre##pair_t *p = (_pre##pair_t *) (m->a.data);			\
+      for (size_t c = cap(&m->a); *i < c; (*i)++)			\
+	if (p[*i].key != 0) return (*k = p[*i].key, true);		\
+      return false;							\
+    }									\
+    _pre##group_t *q = (_pre##group_t *) (m->a.data);			\
+    for (size_t c = 64 * cap(&m->a); *i < c; (*i)++) {			\
+      uint64_t bits = q[*i >> 6].bits >> (*i & 63);			\
+      if (bits == 0) { *i |= 63; continue; }				\
+      *i += _d_ctz(bits);						\
+      return (*k = *i, true);						\
+    }									\
+    return false;							\
+  }									\
+									\
+  static inline _vtype *_pre##at(dsymmap_t m, size_t i) {		\
+    if (!m->dense) return &(((_pre##pair_t *) (m->a.data))[i].val);	\
+    return &(((_pre##group_t *) (m->a.data))[i >> 6].v[i & 63]);	\
+  }									\
+
+
+/** N-gram counts can be kept in a single hash table whose keys pack
+the symbols of the n-gram into one integer, instead of a table of
+tables with one inner table per context.  Each n-gram then costs one
+element in one table and one lookup, and there is no per-context
+allocation or slack.  `D_NGRAM2(x)` defines a `D_HASH` table of
+`dngram2_t` elements for bigrams, and `D_NGRAM4(x)` one of `dngram4_t`
+elements for up to four symbols:
+
+	typedef struct { uint64_t key; size_t cnt; } dngram2_t;
+	typedef struct { uint64_t hi, lo; } dkey4_t;
+	typedef struct { dkey4_t key; size_t cnt; } dngram4_t;
+
+Keys are made with `d_key2(a, b)` and `d_key4(a, b, c, d)`, where
+shorter n-grams (e.g. trigrams) leave the trailing symbols 0, and the
+i'th symbol of a key is `d_key2sym(key, i)` or `d_key4sym(key, i)`.
+The first symbol should not be 0.  Keys are hashed with `d_mix64`.
+
+	D_NGRAM2(b)
+	darr_t cnt = darr(0, dngram2_t);
+	bget(cnt, d_key2(prev, cur), true)->cnt++;
+
+To visit n-grams by context (their first n-1 symbols),
+`ngram2_sort(h)` or `ngram4_sort(h)` packs the elements of the table
+to the front of its array and sorts them by key, which turns the table
+into a plain array of `len(h)` elements (it can no longer be used with
+`xget`).  All n-grams with the same context are then adjacent, and
+`ngram2_ctxend(h, i, n)` (or `ngram4_ctxend`) returns the index after
+the last one that shares the context of element `i`:
+
+	ngram2_sort(cnt);
+	for (size_t i = 0, j; i < len(cnt); i = j) {
+	  j = ngram2_ctxend(cnt, i, 2);
+	  // elements i..j-1 are the bigrams starting with d_key2sym(key, 0)
+	}
+
+*/
+
+typedef struct { uint64_t key; size_t cnt; } dngram2_t;
+typedef struct { uint64_t hi, lo; } dkey4_t;
+typedef struct { dkey4_t key; size_t cnt; } dngram4_t;
+
+#define d_key2(a, b) ((((uint64_t) (a)) << 32) | (uint32_t) (b))
+#define d_key4(a, b, c, d) ((dkey4_t) { d_key2(a, b), d_key2(c, d) })
+#define d_key2sym(k, i) ((sym_t) ((k) >> (32 - 32 * (i))))
+#define d_key4sym(k, i) d_key2sym(((i) < 2) ? (k).hi : (k).lo, (i) & 1)
+#define d_key4eq(a, b) (((a).hi == (b).hi) && ((a).lo == (b).lo))
+#define d_key4hash(k) d_mix64((k).hi ^ d_mix64((k).lo))
+#define d_key4isnull(e) ((e).key.hi == 0)
+#define d_key4mknull(e) ((e).key.hi = 0)
+#define d_keyiszero(e) ((e).key == 0)
+#define d_keymkzero(e) ((e).key = 0)
+#define _d_ngram2init(k) ((dngram2_t) { (k), 0 })
+#define _d_ngram4init(k) ((dngram4_t) { (k), 0 })
+
+#define D_NGRAM2(_pre)							\
+  D_HASH(_pre, dngram2_t, uint64_t, d_keyof, d_eqmatch, d_mix64, _d_ngram2init, d_keyiszero, d_keymkzero)
+
+#define D_NGRAM4(_pre)							\
+  D_HASH(_pre, dngram4_t, dkey4_t, d_keyof, d_key4eq, d_key4hash, _d_ngram4init, d_key4isnull, d_key4mknull)
+
+extern void ngram2_sort(darr_t h);
+extern void ngram4_sort(darr_t h);
+
+/* _d_keypre(x, y, m) is true if the first m (0, 1 or 2) symbols of
+   the packed pairs x and y are the same. */
+
+#define _d_keypre(x, y, m) (((m) <= 0) || (((m) == 1) ? (((x) >> 32) == ((y) >> 32)) : ((x) == (y))))
+
+static inline size_t ngram2_ctxend(darr_t h, size_t i, int n) {
+  dngram2_t *a = (dngram2_t *) (h->data);
+  size_t j = i + 1, l = len(h);
+  while ((j < l) && _d_keypre(a[i].key, a[j].key, n - 1)) j++;
+  return j;
+}
+
+static inline size_t ngram4_ctxend(darr_t h, size_t i, int n) {
+  dngram4_t *a = (dngram4_t *) (h->data);
+  size_t j = i + 1, l = len(h);
+  while ((j < l) && _d_keypre(a[i].key.hi, a[j].key.hi, n - 1) &&
+	 _d_keypre(a[i].key.lo, a[j].key.lo, n - 3)) j++;
+  return j;
+}
+
+
+/** Most keys in a table of word or n-gram counts are seen once or
+twice, so a `size_t` count (plus padding) is mostly wasted.
+`D_COUNT(x, ktype)` defines a counting table type `dcount_t` for
+integer keys (e.g. `sym_t`, or `uint64_t` keys made with `d_key2`)
+that keeps one byte per key for its count:
+
+	dcount_t xnew(size_t n);
+	void xinc(dcount_t cnt, ktype key);
+	void xadd(dcount_t cnt, ktype key, size_t n);
+	size_t xcnt(dcount_t cnt, ktype key);
+
+`xnew(n)` creates a table that can hold `n` keys without growing,
+`xinc` and `xadd` add 1 or `n` to the count of `key` (inserting it if
+necessary), and `xcnt` returns its count (0 if it is not in the
+table).  Counts of 255 and above are kept in a second hash table of
+(key, `size_t`) pairs, which only the frequent keys reach.  A table
+costs `sizeof(ktype) + 1` bytes per slot instead of 16 for a table of
+(key, `size_t`) elements.  Keys are hashed with `d_mix64`.  0 cannot
+be a key: `xinc` and `xadd` ignore it and `xcnt` returns 0 for it, so
+e.g. the 0 that `str2sym(tok, false)` returns for an unknown word is
+not counted.  `len(&cnt->a)` gives the number of keys, `dcount_free`
+frees the table, and
+
+	forcount(x, k, n, cnt)
+
+iterates over the keys `ktype k` and their counts `size_t n`.
+
+	D_COUNT(w, sym_t)
+	dcount_t cnt = wnew(0);
+	fortok (tok, str) winc(cnt, str2sym(tok, true));
+
+*/
+
+/* The slots of a dcount_t hold cap keys followed by cap count bytes.
+   A count byte of _D_CNTMAX means that the count is in over.  The
+   paths through over and the growth path are out of line so that xinc
+   and xcnt inline to a probe and a byte update. */
+
+#define _D_CNTMAX 255
+
+typedef struct dcount_s {
+  struct darr_s a;
+  darr_t over;
+} *dcount_t;
+
+extern void dcount_free(dcount_t t);
+
+#define forcount(_pre, _k, _n, _t)					\
+  for (size_t _k##_i = 0, _n = 0; _pre##next((_t), &_k##_i, &_n); _k##_i++) \
+    for (_pre##key_t _k = ((_pre##key_t *) ((_t)->a.data))[_k##_i], *_k##_p = &_k; _k##_p != NULL; _k##_p = NULL)
+
+#define D_COUNT(_pre, _ktype)						\
+  typedef _ktype _pre##key_t;						\
+  typedef struct { _ktype key; size_t cnt; } _pre##over_t;		\
+									\
+  static inline _pre##over_t _pre##overinit(_ktype k) {			\
+    return (_pre##over_t) { k, 0 };					\
+  }									\
+									\
+  D_HASH(_pre##o, _pre##over_t, _ktype, d_keyof, d_eqmatch, d_mix64, _pre##overinit, d_keyiszero, d_keymkzero) \
+									\
+  static inline uint8_t *_pre##cnts(dcount_t t) {			\
+    return (uint8_t *) (((_ktype *) (t->a.data)) + cap(&t->a));		\
+  }									\
+									\
+  static inline size_t _pre##idx(dcount_t t, _ktype k) {		\
+    size_t mask = cap(&t->a) - 1;					\
+    _ktype *d = (_ktype *) (t->a.data);					\
+    size_t i = d_mix64(k) & mask, step = 0;				\
+    while ((d[i] != 0) && (d[i] != k))					\
+      i = (i + (++step)) & mask;					\
+    return i;								\
+  }									\
+									\
+  static inline void _pre##rehash(dcount_t t, size_t b) {		\
+    size_t c = cap(&t->a);						\
+    _ktype *d = (_ktype *) (t->a.data);					\
+    uint8_t *n = _pre##cnts(t);						\
+    t->a.data = _d_calloc(1ULL << b, sizeof(_ktype) + 1);		\
+    _d_setcapbits(&t->a, b);						\
+    _ktype *d2 = (_ktype *) (t->a.data);				\
+    uint8_t *n2 = _pre##cnts(t);					\
+    for (size_t i = 0; i < c; i++) {					\
+      if (d[i] == 0) continue;						\
+      size_t j = _pre##idx(t, d[i]);					\
+      d2[j] = d[i]; n2[j] = n[i];					\
+    }									\
+    _d_free(d);								\
+  }									\
+									\
+  static _d_noinline dcount_t _pre##new(size_t n) {			\
+    dcount_t t = _d_calloc(1, sizeof(struct dcount_s));			\
+    size_t b = _d_hbits(n, D_HLOAD);					\
+    t->a.data = _d_calloc(1ULL << b, sizeof(_ktype) + 1);		\
+    _d_setcapbits(&t->a, b);						\
+    t->over = darr(0, _pre##over_t);					\
+    return t;								\
+  }									\
+									\
+  static _d_noinline size_t _pre##grow(dcount_t t, _ktype k) {		\
+    _pre##rehash(t, _d_capbits(&t->a) + 1);				\
+    return _pre##idx(t, k);						\
+  }									\
+									\
+  static _d_noinline void _pre##overadd(dcount_t t, _ktype k,		\
+					uint8_t *c, size_t n) {		\
+    if (*c == _D_CNTMAX) {						\
+      _pre##oget(t->over, k, false)->cnt += n;				\
+    } else {								\
+      _pre##oget(t->over, k, true)->cnt = *c + n;			\
+      *c = _D_CNTMAX;							\
+    }									\
+  }									\
+									\
+  static _d_noinline size_t _pre##overcnt(dcount_t t, _ktype k) {	\
+    return _pre##oget(t->over, k, false)->cnt;				\
+  }									\
+									\
+  static inline void _pre##add(dcount_t t, _ktype k, size_t n) {	\
+    if (k == 0) return;							\
+    size_t i = _pre##idx(t, k);						\
+    _ktype *d = (_ktype *) (t->a.data);					\
+    if (d[i] == 0) {							\
+      if (len(&t->a) >= _d_hmax(cap(&t->a), D_HLOAD)) {			\
+	i = _pre##grow(t, k);						\
+	d = (_ktype *) (t->a.data);					\
+      }									\
+      d[i] = k;								\
+      _d_inclen(&t->a);							\
+    }									\
+    uint8_t *c = &_pre##cnts(t)[i];					\
+    if (*c + n < _D_CNTMAX) *c += n;					\
+    else _pre##overadd(t, k, c, n);					\
+  }									\
+									\
+  static inline void _pre##inc(dcount_t t, _ktype k) {			\
+    _pre##add(t, k, 1);							\
+  }									\
+									\
+  static inline size_t _pre##cnt(dcount_t t, _ktype k) {		\
+    size_t i = _pre##idx(t, k);						\
+    if (((_ktype *) (t->a.data))[i] == 0) return 0;			\
+    uint8_t c = _pre##cnts(t)[i];					\
+    return (c == _D_CNTMAX) ? _pre##overcnt(t, k) : c;			\
+  }									\
+									\
+  static inline bool _pre##next(dcount_t t, size_t *i, size_t *n) {	\
+    _ktype *d = (_ktype *) (t->a.data);					\
+    for (size_t c = cap(&t->a); *i < c; (*i)++) {			\
+      if (d[*i] == 0) continue;						\
+      uint8_t v = _pre##cnts(t)[*i];					\
+      *n = (v == _D_CNTMAX) ? _pre##overcnt(t, d[*i]) : v;		\
+      return true;							\
+    }									\
+    return false;							\
+  }									\
+
+
+/** When the vocabulary of a stream does not fit in memory, exact
+counts are out of reach but approximate ones are not.  A sketch
+counts strings in a fixed amount of memory:
+
+	dsketch_t sketch_new(size_t nbytes, size_t k, size_t (*hash)(const char *));
+	void sketch_add(dsketch_t s, const char *key, size_t n);
+	void sketch_addh(dsketch_t s, const char *key, uint64_t hv, size_t n);
+	size_t sketch_get(dsketch_t s, const char *key);
+	darr_t sketch_top(dsketch_t s);
+	void sketch_free(dsketch_t s);
+
+`sketch_new` creates a count-min sketch of `D_SKETCHDEPTH` (default 4)
+rows of 32-bit counters that takes at most `nbytes` bytes, and a
+Space-Saving table of the `k` most frequent keys.  `hash` hashes the
+keys (`strhash` if `NULL`, or e.g. `fnv1a`); `sketch_addh` takes a
+hash value computed by the caller (e.g. with `wyhash` over a span).
+`sketch_add` adds `n` to the count of `key`: each row has one counter
+for the key, and a conservative update raises only the counters below
+the new estimate.  `sketch_get` returns an estimate that is never
+below the true count and exceeds it by at most `e N` with probability
+`1 - exp(-depth)`, where `N` is the total count and `e = 2.72 / w`
+for rows of `w` counters.  The Space-Saving table holds `k` keys
+(copying each of them) with an upper bound on their counts: a key that
+is not in the table replaces the one with the smallest bound `m` and
+gets the bound `m + n`.  Every key whose count is above `N / k` is in
+the table, and `sketch_get` uses the smaller of the two bounds.
+`sketch_top` returns its elements, of type `dheavy_t`, as an array
+sorted by decreasing count, where `cnt` is an upper bound on the count
+of `key` and `cnt - err` a lower bound.  The keys belong to the
+sketch and the array should be freed with `darr_free`.  Keys are
+identified by their 64-bit hash value in the table, and a sketch
+should not be used by multiple threads.
+
+	dsketch_t s = sketch_new(1 << 26, 1000, NULL);
+	forline (str, NULL) fortok (tok, str) sketch_add(s, tok, 1);
+	darr_t top = sketch_top(s);
+
+*/
+
+#ifndef D_SKETCHDEPTH
+#define D_SKETCHDEPTH 4
+#endif
+
+typedef struct dsketch_s *dsketch_t;
+typedef struct { char *key; size_t cnt, err; uint64_t hv; } dheavy_t;
+extern dsketch_t sketch_new(size_t nbytes, size_t k, size_t (*hash)(const char *));
+extern void sketch_free(dsketch_t s);
+extern void sketch_add(dsketch_t s, const char *key, size_t n);
+extern void sketch_addh(dsketch_t s, const char *key, uint64_t hv, size_t n);
+extern size_t sketch_get(dsketch_t s, const char *key);
+extern darr_t sketch_top(dsketch_t s);
+
+
+/** A set that only needs to answer whether a string has been seen
+(e.g. to remove duplicate lines, or to count distinct tokens) does not
+need the strings.  `D_FPSET(x)` defines a `D_HASH` set of 64-bit
+fingerprints, and `D_FPSET128(x)` one of 128-bit fingerprints (of
+type `dkey4_t`), with:
+
+	bool xfpadd(darr_t set, const char *str);
+	bool xfphas(darr_t set, const char *str);
+
+`xfpadd` adds the fingerprint of `str` to the set and returns `true`
+if it was not already there, and `xfphas` tests it without adding.
+The fingerprints are `d_fp64(str)` and `d_fp128(str)`, computed with
+`wyhash` and seeds `D_FPSEED`, so a set takes 8 or 16 bytes per slot
+however long the strings are (use `D_STRSET` if the strings are
+needed).  The price is that two different strings may get the same
+fingerprint, in which case the second one is taken for a duplicate.
+With `n` distinct strings the probability of any such collision is
+about `n^2 / 2^65` for 64-bit fingerprints (1 in 37 million for a
+million strings, 3% for a billion) and `n^2 / 2^129` for 128-bit ones.
+A fingerprint of 0 marks an empty slot, so `d_fp64` maps 0 to 1.
+
+	D_FPSET(u)
+	darr_t seen = darr(0, uint64_t);
+	forline (str, NULL) if (ufpadd(seen, str)) fputs(str, stdout);
+
+*/
+
+#ifndef D_FPSEED
+#define D_FPSEED 0x243F6A8885A308D3ULL
+#endif
+
+static inline uint64_t d_fp64(const char *s) {
+  uint64_t f = wyhash(s, strlen(s), D_FPSEED);
+  return (f == 0) ? 1 : f;
+}
+
+static inline dkey4_t d_fp128(const char *s) {
+  size_t n = strlen(s);
+  dkey4_t f = { wyhash(s, n, D_FPSEED), wyhash(s, n, ~D_FPSEED) };
+  if (f.hi == 0) f.hi = 1;
+  return f;
+}
+
+/* xfpadd and xfphas are a wyhash call and an inlined xget.  The
+   growth path of xget (xresize) is out of line, so the two stay small
+   enough to inline at every call site. */
+
+#define _d_fplo(k) ((k).lo)
+#define _d_fpisnull(e) ((e).hi == 0)
+#define _d_fpmknull(e) ((e).hi = 0)
+
+#define D_FPSET(_pre)							\
+  D_HASH(_pre, uint64_t, uint64_t, d_ident, d_eqmatch, d_ident, d_ident, d_iszero, d_mkzero) \
+  _D_FPSET(_pre, d_fp64)
+
+#define D_FPSET128(_pre)						\
+  D_HASH(_pre, dkey4_t, dkey4_t, d_ident, d_key4eq, _d_fplo, d_ident, _d_fpisnull, _d_fpmknull) \
+  _D_FPSET(_pre, d_fp128)
+
+#define _D_FPSET(_pre, _fp)						\
+  static inline bool _pre##fpadd(darr_t h, const char *s) {		\
+    size_t l = len(h);							\
+    _pre##get(h, _fp(s), true);						\
+    return (len(h) > l);						\
+  }									\
+									\
+  static inline bool _pre##fphas(darr_t h, const char *s) {		\
+    return (_pre##get(h, _fp(s), false) != NULL);			\
+  }									\
+
+
+/** Counts that do not fit in memory can be collected on disk:
+
+	dextcnt_t extcnt_new(size_t nbytes, const char *tmpdir);
+	void extcnt_add(dextcnt_t c, const char *key, size_t n);
+	void extcnt_merge(dextcnt_t c, void (*fn)(const char *key, size_t cnt, void *arg), void *arg);
+	void extcnt_free(dextcnt_t c);
+
+`extcnt_add` adds `n` to the count of the string `key` in a hash table
+in memory.  When the table and its keys take more than `nbytes` bytes,
+its elements are sorted by key (with `strcmp`) and written as a run of
+"key\tcount" lines to a new directory under `tmpdir` (`$TMPDIR` or
+`/tmp` if `NULL`), compressed with zlib unless `_NO_ZLIB` is defined,
+and the table starts over empty.  `extcnt_merge` merges the runs and
+the table, summing the counts of equal keys, and calls `fn` with each
+key and its total count in sorted order.  More keys can be added after
+a merge, and a later merge reports the totals of all the keys added
+so far.  If there are more than `D_EXTFANIN` (default 64) runs, they
+are first merged in groups of `D_EXTFANIN` into longer runs.
+`extcnt_free` removes the runs and the directory.  Keys should not
+contain newlines, and the disk should have room for the compressed
+counts.
+
+	dextcnt_t c = extcnt_new(1ULL << 34, NULL);
+	forline (str, NULL) fortok (tok, str) extcnt_add(c, tok, 1);
+	extcnt_merge(c, print, NULL);
+	extcnt_free(c);
+
+*/
+
+#ifndef D_EXTFANIN
+#define D_EXTFANIN 64
+#endif
+
+typedef struct dextcnt_s *dextcnt_t;
+extern dextcnt_t extcnt_new(size_t nbytes, const char *tmpdir);
+extern void extcnt_add(dextcnt_t c, const char *key, size_t n);
+extern void extcnt_merge(dextcnt_t c, void (*fn)(const char *key, size_t cnt, void *arg), void *arg);
+extern void extcnt_free(dextcnt_t c);
+
 
 /* TODO:
    double hash?
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+typedef struct { uint64_t key; uint64_t val; } etype;
+#define einit(k) ((etype) { (k), 0 })
+D_HASH(h, etype, uint64_t, d_keyof, d_eqmatch, d_mix64, einit, d_keyiszero, d_keymkzero)
+
+#define NTOK 1024
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  size_t n = (argc > 2) ? strtoul(argv[2], NULL, 10) : (1 << 22);
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t cnt = darr(0, strcnt_t);
+  char *tok[NTOK];
+  strcnt_t *e[NTOK];
+  forline (str, fname) {
+    size_t ntok = 0;
+    fortok (t, str) {
+      tok[ntok++] = t;
+      if (ntok == NTOK) {
+	sget_batch(cnt, tok, ntok, true, e);
+	for (size_t i = 0; i < ntok; i++) e[i]->cnt++;
+	ntok = 0;
+      }
+    }
+    sget_batch(cnt, tok, ntok, true, e);
+    for (size_t i = 0; i < ntok; i++) e[i]->cnt++;
+  }
+  forhash (strcnt_t, p, cnt, d_keyisnull) {
+    sget_batch(cnt, &p->key, 1, false, e);
+    if (e[0] != p) die("%s: lookup mismatch", p->key);
+    printf("%s\t%zu\n", p->key, p->cnt);
+  }
+  char *missing = "no such word";
+  sget_batch(cnt, &missing, 1, false, e);
+  if (e[0] != NULL) die("found a missing key");
+
+  msg("Inserting %zu integer keys", n);
+  darr_t h = darr(0, etype);
+  uint64_t *key = _d_malloc(n * sizeof(uint64_t));
+  for (size_t i = 0; i < n; i++) hget(h, (key[i] = i + 1), true)->val = i;
+  msg("Looking them up one at a time");
+  size_t sum1 = 0, sum2 = 0;
+  for (size_t i = 0; i < n; i++) sum1 += hget(h, key[n - 1 - i], false)->val;
+  msg("Looking them up in batches of %d", NTOK);
+  etype **out = _d_malloc(NTOK * sizeof(etype *));
+  for (size_t i = 0; i < n; i += NTOK) {
+    size_t m = (n - i < NTOK) ? (n - i) : NTOK;
+    hget_batch(h, &key[i], m, false, out);
+    for (size_t j = 0; j < m; j++) sum2 += out[j]->val;
+  }
+  if (sum1 != sum2) die("batch lookup mismatch");
+  msg("Inserting the same keys in batches into a new table");
+  darr_t h2 = darr(0, etype);
+  for (size_t i = 0; i < n; i += NTOK) {
+    size_t m = (n - i < NTOK) ? (n - i) : NTOK;
+    hget_batch(h2, &key[i], m, true, out);
+    for (size_t j = 0; j < m; j++) out[j]->val = i + j;
+  }
+  if (len(h2) != n) die("len(h2)=%zu", len(h2));
+  for (size_t i = 0; i < n; i++)
+    if (hget(h2, key[i], false)->val != i) die("batch insert mismatch");
+  _d_free(out);
+  _d_free(key);
+  darr_free(h2);
+  darr_free(h);
+  darr_free(cnt);
+  msg("done");
+}
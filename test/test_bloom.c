@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  double frac = (argc > 2) ? strtod(argv[2], NULL) : 0.5;
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t lines = darr(0, char *);
+  forline (str, fname) val(lines, len(lines), char *) = strdup(str);
+  size_t ntrain = frac * len(lines);
+  if ((ntrain == 0) || (ntrain >= len(lines))) die("cannot split %zu lines at %g", len(lines), frac);
+  darr_t vocab = darr(0, strcnt_t);
+  darr_t oov = darr(0, strcnt_t);
+  size_t ntok = 0, nhit = 0, nfalse = 0;
+  for (size_t i = 0; i < ntrain; i++) {
+    fortok (tok, val(lines, i, char *)) {
+      sget(vocab, tok, true)->cnt++;
+      str2sym(tok, true);
+    }
+  }
+  msg("%zu words in the first %zu lines, checking the other %zu", len(vocab), ntrain, len(lines) - ntrain);
+  dbloom_t b = sbloom(vocab);
+  symtable_bloom();
+  for (size_t i = ntrain; i < len(lines); i++) {
+    fortok (tok, val(lines, i, char *)) {
+      strcnt_t *e = sget(vocab, tok, false);
+      if (sbget(vocab, b, tok) != e) die("%s: sbget mismatch", tok);
+      sym_t u = str2sym(tok, false);
+      if ((u != 0) != (e != NULL)) die("%s: str2sym mismatch", tok);
+      if (u != 0 && strcmp(sym2str(u), tok)) die("%s: wrong symbol", tok);
+      if (e != NULL) { nhit++; continue; }
+      if (bloom_has(b, strhash(tok))) nfalse++;
+      sget(oov, tok, true)->cnt++;
+      ntok++;
+    }
+  }
+  msg("%zu known tokens, %zu unknown tokens, %zu false positives (%.2f%%)",
+      nhit, ntok, nfalse, 100.0 * nfalse / (ntok ? ntok : 1));
+  if ((nhit == 0) || (ntok == 0)) die("nothing to check: need both known and unknown tokens");
+  forhash (strcnt_t, e, oov, d_keyisnull) {
+    if (str2sym(e->key, false) != 0) die("%s: found", e->key);
+    sym_t u = str2sym(e->key, true);
+    if (str2sym(e->key, false) != u) die("%s: new symbol not in filter", e->key);
+    printf("%s\t%zu\n", e->key, e->cnt);
+  }
+  symtable_compress();
+  forhash (strcnt_t, e, oov, d_keyisnull)
+    if (str2sym(e->key, false) == 0) die("%s: lost by compressing", e->key);
+  sym_t u = str2sym("no such word in the corpus", true);
+  if (str2sym("no such word in the corpus", false) != u) die("new symbol not in filter after expanding");
+  bloom_free(b);
+  for (size_t i = 0; i < len(lines); i++) free(val(lines, i, char *));
+  darr_free(lines);
+  darr_free(oov);
+  darr_free(vocab);
+  symtable_free();
+  msg("done");
+}
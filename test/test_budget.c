@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { _d_strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+static size_t nprune, npruned, nthrash, maxmem;
+
+/* Drop the words seen once so far from the table arg points to. */
+static void prune(void *arg) {
+  darr_t h = *(darr_t *) arg;
+  size_t n = npruned;
+  forhash (strcnt_t, e, h, d_keyisnull) {
+    if (e->cnt > 1) continue;
+    _d_free(e->key);
+    e->key = NULL;
+    npruned++;
+  }
+  srekey(h);
+  nprune++;
+  if (npruned == n) nthrash++;
+}
+
+static void check(darr_t cnt, darr_t exact, const char *what) {
+  msg("%s: %zu pruning calls dropped %zu words, %zu words left, peak %zu over budget",
+      what, nprune, npruned, len(cnt), maxmem > _d_membudget ? maxmem - _d_membudget : 0);
+  if (nprune == 0) die("%s: budget not enforced", what);
+  if (nthrash > 0) msg("warning: %zu pruning calls dropped nothing, the budget is too small", nthrash);
+  forhash (strcnt_t, e, cnt, d_keyisnull) {
+    strcnt_t *f = sget(exact, e->key, false);
+    if (f == NULL || f->cnt < e->cnt) die("%s: %s: %zu > exact count", what, e->key, e->cnt);
+  }
+  nprune = npruned = nthrash = maxmem = 0;
+}
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t lines = darr(0, char *);
+  darr_t words = darr(0, char *);	/* the tokens, NULL after each line */
+  forline (str, fname) {
+    char *s = val(lines, len(lines), char *) = strdup(str);
+    fortok (tok, s) val(words, len(words), char *) = tok;
+    val(words, len(words), char *) = NULL;
+  }
+  char **w = (char **) words->data;
+  size_t nw = len(words);
+
+  msg("Counting %zu lines exactly", len(lines));
+  int64_t m0 = _d_memsize;
+  darr_t exact = darr(0, strcnt_t);
+  for (size_t i = 0; i < nw; i++)
+    if (w[i] != NULL) sget(exact, w[i], true)->cnt++;
+  size_t budget = (argc > 2) ? strtoul(argv[2], NULL, 10) : (size_t) (_d_memsize - m0) / 2;
+  if (budget == 0) die("_d_memsize is not maintained, cannot test the budget");
+  msg("%zu words in %zu bytes, counting again within %zu more bytes",
+      len(exact), (size_t) (_d_memsize - m0), budget);
+
+  darr_t cnt = darr(0, strcnt_t), cur = cnt;
+  dmembudget(_d_memsize + budget);
+  dmemprune(prune, &cur);
+  for (size_t i = 0; i < nw; i++) {
+    if (w[i] == NULL) continue;
+    sget(cnt, w[i], true)->cnt++;
+    if (_d_memsize > (int64_t) maxmem) maxmem = _d_memsize;
+  }
+  check(cnt, exact, "sget");
+  forhash (strcnt_t, e, cnt, d_keyisnull) {
+    printf("%s\t%zu\n", e->key, e->cnt);
+    _d_free(e->key);
+  }
+  darr_free(cnt);
+
+  /* Batches insert keys with a count of 0, which the pruning drops
+     first, so every pointer sget_batch returns must still hold its key. */
+  darr_t bcnt = cur = darr(0, strcnt_t);
+  dmembudget(_d_memsize + budget);
+  strcnt_t *out[D_BATCH * 4];
+  for (size_t i = 0, n; i < nw; i += n) {
+    if (w[i] == NULL) { n = 1; continue; }
+    for (n = 0; (w[i + n] != NULL) && (n < sizeof(out) / sizeof(out[0])); n++);
+    sget_batch(bcnt, &w[i], n, true, out);
+    for (size_t j = 0; j < n; j++) {
+      if ((out[j] == NULL) || (out[j]->key == NULL) || strcmp(out[j]->key, w[i + j]))
+	die("sget_batch: %s: lost under the budget", w[i + j]);
+      out[j]->cnt++;
+    }
+    if (_d_memsize > (int64_t) maxmem) maxmem = _d_memsize;
+  }
+  check(bcnt, exact, "sget_batch");
+
+  dmembudget(0);
+  forhash (strcnt_t, e, bcnt, d_keyisnull) _d_free(e->key);
+  forhash (strcnt_t, e, exact, d_keyisnull) _d_free(e->key);
+  darr_free(bcnt);
+  darr_free(exact);
+  for (size_t i = 0; i < len(lines); i++) free(val(lines, i, char *));
+  darr_free(lines);
+  darr_free(words);
+  msg("done, %zu bytes still allocated", (size_t) _d_memsize);
+}
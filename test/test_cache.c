@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { _d_strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+static size_t nfree;
+#define freecnt(e) (_d_free((e).key), nfree++)
+D_CACHE(c, strcnt_t, char *, d_keyof, d_strmatch, strhash, newcnt, d_keyisnull, d_keymknull, freecnt)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  size_t n = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000;
+  msg("Caching words of %s in %zu entries", fname == NULL ? "stdin" : fname, n);
+  darr_t exact = darr(0, strcnt_t);
+  darr_t cache = cnew(n);
+  size_t ntok = 0, nhit = 0, nins = 0, ndel = 0;
+  forline (str, fname) {
+    fortok (tok, str) {
+      ntok++;
+      strcnt_t *e = cget(cache, tok, false);
+      if (e != NULL) nhit++;
+      else { e = cget(cache, tok, true); nins++; }
+      e->cnt++;
+      if (strcmp(e->key, tok)) die("%s: wrong key %s", tok, e->key);
+      size_t x = ++sget(exact, tok, true)->cnt;
+      if (e->cnt > x) die("%s: %zu > exact count %zu", tok, e->cnt, x);
+      if (len(cache) > _d_hmax(cap(cache), D_CLOAD)) die("cache holds %zu entries", len(cache));
+      if ((x % 100 == 0) && cdel(cache, tok)) ndel++;
+    }
+  }
+  msg("%zu tokens, %zu words, %zu hits, %zu inserts, %zu deletes, %zu cached",
+      ntok, len(exact), nhit, nins, ndel, len(cache));
+  if (nfree + len(cache) != nins) die("%zu freed + %zu cached != %zu inserted", nfree, len(cache), nins);
+  size_t ncache = 0;
+  forhash (strcnt_t, e, cache, d_keyisnull) {
+    ncache++;
+    if (cget(cache, e->key, false) != e) die("%s: not found", e->key);
+    if (e->cnt > sget(exact, e->key, false)->cnt) die("%s: count too large", e->key);
+    printf("%s\t%zu\n", e->key, e->cnt);
+  }
+  if (ncache != len(cache)) die("%zu elements, len %zu", ncache, len(cache));
+  if (cdel(cache, "") || cget(cache, "", false) != NULL) die("empty key found");
+  cfree(cache);
+  if (nfree != nins) die("%zu freed != %zu inserted", nfree, nins);
+  forhash (strcnt_t, e, exact, d_keyisnull) _d_free(e->key);
+  darr_free(exact);
+  msg("done");
+}
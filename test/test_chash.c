@@ -0,0 +1,53 @@
+#include <stdio.h>
+/* Resize in parallel early, while the counting threads wait for it. */
+#define D_PMIN 1024
+#include "dlib.h"
+
+typedef struct strcnt_s { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+
+D_CHASH(p, strcnt_t, char *, d_keyof, d_strmatch, fnv1a, newcnt, d_keyisnull, d_keymknull)
+D_HASH(s, strcnt_t, char *, d_keyof, d_strmatch, fnv1a, newcnt, d_keyisnull, d_keymknull)
+
+static dchash_t htable;
+static darr_t lines;
+
+static void count(void *arg, size_t tid, size_t n) {
+  (void) arg;
+  for (size_t i = tid; i < len(lines); i += n) {
+    char *str = val(lines, i, char *);
+    plock(htable);
+    fortok (tok, str) {
+      datomic_inc(pget(htable, tok, true)->cnt);
+    }
+    punlock(htable);
+  }
+}
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  dthreads((argc > 2) ? strtoul(argv[2], NULL, 10) : 8);
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  lines = darr(0, char *);
+  darr_t exact = darr(0, strcnt_t);	/* counted serially to check htable */
+  forline (str, fname) {
+    val(lines, len(lines), char *) = strdup(str);
+    fortok (tok, str) sget(exact, tok, true)->cnt++;
+  }
+  msg("Counting with %zu threads", _d_nthreads);
+  htable = pnew(0);
+  _d_parallel(count, NULL);
+  msg("len(htable)=%zu cap(htable)=%zu", len(&htable->a), cap(&htable->a));
+  if (len(exact) != len(&htable->a))
+    die("%zu words, expected %zu", (size_t) len(&htable->a), (size_t) len(exact));
+  forchash (strcnt_t, e, htable, d_keyisnull) {
+    strcnt_t *f = sget(exact, e->key, false);
+    if ((f == NULL) || (f->cnt != e->cnt)) die("%s: %zu, expected %zu", e->key, e->cnt, f ? f->cnt : 0);
+    printf("%s\t%lu\n", e->key, e->cnt);
+    free(e->key);
+  }
+  forhash (strcnt_t, e, exact, d_keyisnull) free(e->key);
+  darr_free(exact);
+  dchash_free(htable);
+  msg("done");
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include "dlib.h"
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t cnt = darr(0, size_t);
+  forline (str, fname) {
+    fortok (tok, str) {
+      sym_t u = str2sym(tok, true);
+      while (u >= len(cnt)) val(cnt, len(cnt), size_t) = 0;
+      val(cnt, u, size_t)++;
+    }
+  }
+  size_t n = len(cnt) - 1;
+  darr_t strs = darr(n + 1, str_t);
+  for (sym_t u = 1; u <= n; u++) val(strs, u, str_t) = strdup(sym2str(u));
+  msg("Compressing %zu symbols", n);
+  symtable_compress();
+  msg("Compressed");
+  str_t prev = NULL;
+  for (sym_t u = 1; u <= n; u++) {
+    str_t s = val(strs, u, str_t), t = sym2str(u);
+    if (strcmp(t, s) || (str2sym(s, false) != u) || (str2sym(t, false) != u))
+      die("%s: compressed symbol mismatch", s);
+    if ((prev != NULL) && strcmp(prev, val(strs, u - 1, str_t)))
+      die("sym2str result overwritten by a later call");
+    prev = t;
+    printf("%s\t%zu\n", s, val(cnt, u, size_t));
+  }
+  char buf[1024];
+  for (sym_t u = 1; u <= n; u++) {
+    size_t l = strlen(val(strs, u, str_t));
+    if (l + 2 > sizeof(buf)) continue;
+    memcpy(buf, val(strs, u, str_t), l + 1);
+    buf[l] = 'x'; buf[l + 1] = 0;
+    sym_t v = str2sym(buf, false);
+    if ((v != 0) && strcmp(sym2str(v), buf)) die("%s: wrong symbol for an extension", buf);
+    buf[l - 1] = 0;
+    v = str2sym(buf, false);
+    if ((v != 0) && strcmp(sym2str(v), buf)) die("%s: wrong symbol for a prefix", buf);
+  }
+  if ((str2sym("no such word in the corpus", false) != 0) || (str2sym("", false) != 0) ||
+      (str2sym("\x7f\x7f", false) != 0)) die("compressed lookup of missing key");
+  if (str2sym("no such word in the corpus", true) != n + 1) die("expand failed");
+  for (sym_t u = 1; u <= n; u++)
+    if (strcmp(sym2str(u), val(strs, u, str_t)) || (str2sym(val(strs, u, str_t), false) != u))
+      die("%u: expanded symbol mismatch", u);
+  symtable_free();
+  msg("done");
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "dlib.h"
+
+D_COUNT(w, sym_t)
+D_COUNT(b, uint64_t)
+D_NGRAM2(n)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  sym_t bos = str2sym("<s>", true);
+  dcount_t words = wnew(0);
+  dcount_t pairs = bnew(0);
+  darr_t ncnt = darr(0, dngram2_t);
+  size_t ntok = 0;
+  forline (str, fname) {
+    sym_t prev = bos;
+    fortok (tok, str) {
+      sym_t u = str2sym(tok, true);
+      winc(words, u);
+      binc(pairs, d_key2(prev, u));
+      nget(ncnt, d_key2(prev, u), true)->cnt++;
+      prev = u;
+      ntok++;
+    }
+  }
+  msg("%zu tokens, %zu words (%zu over 254), %zu bigrams (%zu over 254)",
+      ntok, len(&words->a), len(words->over), len(&pairs->a), len(pairs->over));
+  msg("bigram bytes: %zu with D_COUNT, %zu with D_NGRAM2",
+      cap(&pairs->a) * (sizeof(uint64_t) + 1) + cap(pairs->over) * sizeof(bover_t),
+      cap(ncnt) * sizeof(dngram2_t));
+  if (len(&pairs->a) != len(ncnt)) die("bigram count mismatch");
+  forhash (dngram2_t, e, ncnt, d_keyiszero) {
+    size_t n = bcnt(pairs, e->key);
+    if (n != e->cnt) die("bigram %zu != %zu", n, e->cnt);
+    if (bcnt(pairs, d_key2(d_key2sym(e->key, 1), bos)) != 0) die("missing bigram has a count");
+    badd(pairs, e->key, 1000);
+    badd(pairs, e->key, 3);
+    if (bcnt(pairs, e->key) != n + 1003) die("badd");
+  }
+  size_t total = 0;
+  forcount (w, k, n, words) {
+    if (wcnt(words, k) != n) die("%s: forcount mismatch", sym2str(k));
+    printf("%s\t%zu\n", sym2str(k), n);
+    total += n;
+  }
+  if (total != ntok) die("unigram count mismatch: %zu != %zu", total, ntok);
+  dcount_t zero = wnew(1000);
+  size_t mask = cap(&zero->a) - 1, nk = 0;
+  for (sym_t k = 1; nk < 3; k++) {
+    if ((d_mix64(k) & mask) != (d_mix64(0) & mask)) continue;
+    winc(zero, 0);
+    wadd(zero, 0, 300);
+    winc(zero, k);
+    nk++;
+    if ((wcnt(zero, 0) != 0) || (wcnt(zero, k) != 1) || (len(&zero->a) != nk))
+      die("key 0 was counted");
+  }
+  dcount_free(zero);
+  darr_free(ncnt);
+  dcount_free(pairs);
+  dcount_free(words);
+  symtable_free();
+  msg("done");
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "dlib.h"
+
+static size_t nkey, ntok, nkey2, ntok2;
+static char last[1024];
+
+static void print(const char *key, size_t cnt, void *arg) {
+  (void) arg;
+  if (nkey > 0 && strcmp(last, key) >= 0) die("%s after %s", key, last);
+  snprintf(last, sizeof(last), "%s", key);
+  printf("%s\t%zu\n", key, cnt);
+  nkey++;
+  ntok += cnt;
+}
+
+static void total(const char *key, size_t cnt, void *arg) {
+  (void) key; (void) arg;
+  nkey2++;
+  ntok2 += cnt;
+}
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  size_t nbytes = (argc > 2) ? strtoul(argv[2], NULL, 10) : (1 << 16);
+  char dir[] = "/tmp/test_extcnt'$(x).XXXXXX";
+  if (mkdtemp(dir) == NULL) die("Cannot create %s", dir);
+  msg("Counting %s in %zu bytes under %s", fname == NULL ? "stdin" : fname, nbytes, dir);
+  dextcnt_t c = extcnt_new(nbytes, dir);
+  size_t n = 0;
+  forline (str, fname) {
+    fortok (tok, str) {
+      extcnt_add(c, tok, 1);
+      n++;
+    }
+  }
+  msg("Merging");
+  extcnt_merge(c, print, NULL);
+  if (ntok != n) die("%zu tokens counted, %zu read", ntok, n);
+  msg("Adding the last key again and merging");
+  extcnt_add(c, last, 2);
+  extcnt_merge(c, total, NULL);
+  if ((nkey2 != nkey) || (ntok2 != n + 2)) die("second merge: %zu tokens, %zu keys", ntok2, nkey2);
+  extcnt_free(c);
+  if (rmdir(dir)) die("%s not empty", dir);
+  msg("%zu tokens, %zu keys", n, nkey);
+  msg("done");
+}
@@ -1,37 +1,64 @@
 #include <stdio.h>
+#include <time.h>
+#include <math.h>
 #include "dlib.h"
 
-#define etype uint64_t
-#define ktype uint64_t
-#define kmatch(a,b) ((a)==(b))
-#define khash(a) (a)
-#define keyof(a) (a)
-#define einit(a) (a)
-#define isnull(a) ((a)==0)
-#define mknull(a) ((a)=0)
+/* Compare the speed and the low bit distribution of the string hash
+   functions on the tokens of a file. */
 
-D_HASH(h, etype, ktype, kmatch, khash, keyof, einit, isnull, mknull)
+D_STRSET(s)
 
 #define BITS 17
+#define REPEAT 10
+
+static size_t collisions(darr_t toks, size_t (*hash)(const char *)) {
+  size_t m = (1ULL << BITS);
+  uint8_t *seen = _d_calloc(m, 1);
+  size_t coll = 0;
+  for (size_t i = 0; i < len(toks); i++) {
+    size_t k = hash(val(toks, i, char *)) & (m - 1);
+    if (seen[k]) coll++;
+    seen[k] = 1;
+  }
+  _d_free(seen);
+  return coll;
+}
+
+static double seconds(darr_t toks, size_t (*hash)(const char *)) {
+  size_t sum = 0;
+  clock_t t = clock();
+  for (int r = 0; r < REPEAT; r++) {
+    for (size_t i = 0; i < len(toks); i++) {
+      sum += hash(val(toks, i, char *));
+    }
+  }
+  double c = (double) (clock() - t) / CLOCKS_PER_SEC;
+  if (sum == 42) msg("lucky");	// keep the loop from being optimized away
+  return c;
+}
 
 int main(int argc, char **argv) {
   char *fname = (argc == 1) ? NULL : argv[1];
   msg("Reading %s", fname == NULL ? "stdin" : fname);
-  darr_t h = hnew(0);
-  size_t total = 0;
-  size_t coll = 0;
+  darr_t toks = darr(0, char *);
+  darr_t uniq = darr(0, char *);
+  darr_t h = darr(0, str_t);
   forline(buf, fname) {
     fortok(tok, buf) {
-      uint64_t k = fnv1a(tok);
-      // k = random() & ((1ULL << BITS)-1);
-      // k = ((k >> BITS) ^ k) & ((1ULL << BITS)-1);
-      k &= ((1ULL << BITS)-1);
-      // printf("%lu\n", k);
-      total++;
-      // if (hget(h, k, 0) != NULL) coll++;
-      // hget(h, k, 1);
+      size_t n = len(h);
+      str_t s = *sget(h, tok, true);
+      val(toks, len(toks), char *) = s;
+      if (len(h) > n) val(uniq, len(uniq), char *) = s;
     }
   }
-  msg("%zu %zu", coll, total);
+  msg("%zu tokens, %zu unique", len(toks), len(uniq));
+  msg("fnv1a: %.3fs for %d passes", seconds(toks, fnv1a), REPEAT);
+  msg("strhash: %.3fs for %d passes", seconds(toks, strhash), REPEAT);
+  double n = len(uniq), m = (1ULL << BITS);
+  msg("collisions in the low %d bits (random: %.0f)", BITS, n - m * (1 - pow(1 - 1 / m, n)));
+  msg("fnv1a: %zu", collisions(uniq, fnv1a));
+  msg("strhash: %zu", collisions(uniq, strhash));
   darr_free(h);
+  darr_free(uniq);
+  darr_free(toks);
 }
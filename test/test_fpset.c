@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include "dlib.h"
+
+D_FPSET(f)
+D_FPSET128(g)
+D_STRSET(s)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t fset = darr(0, uint64_t);
+  darr_t gset = darr(0, dkey4_t);
+  darr_t sset = darr(0, str_t);
+  size_t nline = 0, ndup = 0;
+  darr_t lines = darr(0, uint64_t);
+  forline (str, fname) {
+    nline++;
+    if (!ffpadd(lines, str)) ndup++;
+    fortok (tok, str) {
+      bool f = ffpadd(fset, tok), g = gfpadd(gset, tok);
+      size_t l = len(sset);
+      sget(sset, tok, true);
+      if (f != (len(sset) > l) || g != f) die("%s: fingerprint collision", tok);
+      if (f) printf("%s\n", tok);
+    }
+  }
+  msg("%zu lines, %zu duplicates", nline, ndup);
+  if (len(fset) != len(sset) || len(gset) != len(sset)) die("distinct count mismatch");
+  size_t nbytes = cap(sset) * sizeof(str_t);
+  forhash (str_t, s, sset, d_isnull) {
+    nbytes += strlen(*s) + 1;
+    if (!ffphas(fset, *s) || !gfphas(gset, *s)) die("%s: missing fingerprint", *s);
+  }
+  msg("%zu distinct tokens: %zu bytes with D_FPSET, %zu with D_STRSET",
+      len(fset), cap(fset) * sizeof(uint64_t), nbytes);
+  if (ffphas(fset, "no such word") || gfphas(gset, "no such word")) die("found a missing key");
+  darr_free(lines);
+  darr_free(sset);
+  darr_free(gset);
+  darr_free(fset);
+  msg("done");
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct strcnt_s { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+/* A hash with 2^20 values, so that some words share their value. */
+#define weakhash(k) (strhash(k) & 0xfffff)
+D_HASH(w, strcnt_t, str_t, d_keyof, d_strmatch, weakhash, newcnt, d_keyisnull, d_keymknull)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t htable = darr(0, strcnt_t);
+  forline (str, fname) {
+    fortok (tok, str) {
+      sget(htable, tok, true)->cnt++;
+      str2sym(tok, true);
+    }
+  }
+  msg("len(htable)=%zu cap(htable)=%zu", len(htable), cap(htable));
+  darr_t frozen = sfreeze(htable);
+  msg("len(frozen)=%zu buckets=%zu bytes=%zu (htable bytes=%zu)", len(frozen), cap(frozen),
+      len(frozen) * sizeof(strcnt_t) + cap(frozen) * sizeof(uint32_t), cap(htable) * sizeof(strcnt_t));
+  forhash (strcnt_t, e, htable, d_keyisnull) {
+    strcnt_t *f = sfget(frozen, e->key);
+    if ((f == NULL) || (f->cnt != e->cnt)) die("%s: frozen lookup mismatch", e->key);
+  }
+  if (sfget(frozen, "no such word in the corpus") != NULL) die("frozen lookup of missing key");
+  darr_t weak = darr(0, strcnt_t);
+  forhash (strcnt_t, e, htable, d_keyisnull) wget(weak, e->key, true)->cnt = e->cnt;
+  darr_t wfrozen = wfreeze(weak);
+  msg("weakhash: %u of %zu words in fallback slots", _d_mphdisp(wfrozen, sizeof(strcnt_t))[cap(wfrozen)], len(wfrozen));
+  forhash (strcnt_t, e, weak, d_keyisnull) {
+    strcnt_t *f = wfget(wfrozen, e->key);
+    if ((f == NULL) || (f->cnt != e->cnt)) die("%s: weakhash frozen lookup mismatch", e->key);
+    free(e->key);
+  }
+  if (wfget(wfrozen, "no such word in the corpus") != NULL) die("weakhash frozen lookup of missing key");
+  darr_free(wfrozen);
+  darr_free(weak);
+  darr_free(htable);
+  msg("Freezing the symbol table");
+  sym_t nsym = str2sym("no such word in the corpus", false);
+  symtable_freeze();
+  for (size_t i = 0; i < len(frozen); i++) {
+    strcnt_t *e = &val(frozen, i, strcnt_t);
+    sym_t u = str2sym(e->key, false);
+    if ((u == 0) || strcmp(sym2str(u), e->key)) die("%s: frozen symbol mismatch", e->key);
+    printf("%s\t%zu\n", e->key, e->cnt);
+  }
+  if (nsym != 0 || str2sym("no such word in the corpus", false) != 0) die("frozen symbol of missing key");
+  sym_t u = str2sym("no such word in the corpus", true);
+  if (u != len(frozen) + 1 || str2sym("no such word in the corpus", false) != u) die("thaw failed");
+  symtable_free();
+  darr_free(frozen);
+  msg("done");
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include "dlib.h"
+
+/* Bigram counts in a table of tables: most inner tables hold fewer
+   than D_HMIN successors and are searched without hashing. */
+
+typedef struct { sym_t key; size_t cnt; } symcnt_t;
+#define newcnt(k) ((symcnt_t) { (k), 0 })
+D_HASH(c, symcnt_t, sym_t, d_keyof, d_eqmatch, d_mix64, newcnt, d_keyiszero, d_keymkzero)
+
+typedef struct { sym_t key; darr_t next; } ctx_t;
+#define newctx(k) ((ctx_t) { (k), darr(0, symcnt_t) })
+D_HASH(x, ctx_t, sym_t, d_keyof, d_eqmatch, d_mix64, newctx, d_keyiszero, d_keymkzero)
+
+static void addcnt(symcnt_t *d, const symcnt_t *e) { d->cnt += e->cnt; }
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  dthreads(4);
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  sym_t eos = str2sym("</s>", true);
+  darr_t ctx = darr(0, ctx_t);
+  darr_t uni[3];
+  for (int i = 0; i < 3; i++) uni[i] = darr(0, symcnt_t);
+  size_t nline = 0;
+  forline (str, fname) {
+    sym_t prev = eos;
+    darr_t u = uni[nline++ % 3];
+    fortok (tok, str) {
+      sym_t w = str2sym(tok, true);
+      cget(xget(ctx, prev, true)->next, w, true)->cnt++;
+      cget(u, w, true)->cnt++;
+      prev = w;
+    }
+    cget(xget(ctx, prev, true)->next, eos, true)->cnt++;
+  }
+  size_t nsmall = 0, nbig = 0;
+  forhash (ctx_t, e, ctx, d_keyiszero) {
+    if (cap(e->next) <= D_HMIN) nsmall++; else nbig++;
+  }
+  msg("%zu contexts: %zu small, %zu hashed", len(ctx), nsmall, nbig);
+
+  /* Merging the small tables of each context gives its unigram
+     count, and merging the unigram shards gives the same counts. */
+  darr_t total = darr(0, symcnt_t);
+  cmerge_all(total, uni, 3, addcnt);
+  for (int i = 0; i < 3; i++) darr_free(uni[i]);
+  size_t nmerge = 0;
+  forhash (ctx_t, e, ctx, d_keyiszero) {
+    darr_t m = darr(0, symcnt_t);
+    darr_t one[1] = { e->next };
+    if (nmerge++ < 100) cmerge_all(m, one, 1, addcnt);
+    else cmerge(m, e->next, addcnt);
+    if (len(m) != len(e->next)) die("merge: %zu != %zu", len(m), len(e->next));
+    size_t sum = 0;
+    for (size_t i = 0, c = cap(m); i < c; i++) {
+      symcnt_t *f = &val(m, i, symcnt_t);
+      if (f->key == 0) continue;
+      symcnt_t *g = cget(e->next, f->key, false);
+      if (g == NULL || g->cnt != f->cnt) die("merge mismatch");
+      sum += f->cnt;
+    }
+    darr_free(m);
+    darr_t fz = cfreeze(e->next);
+    for (size_t i = 0; i < len(fz); i++) {
+      symcnt_t *f = &val(fz, i, symcnt_t);
+      if (cfget(fz, f->key) != f) die("cfget mismatch");
+    }
+    darr_free(fz);
+    if (e->key == eos) continue;
+    symcnt_t *t = cget(total, e->key, false);
+    if (t == NULL || t->cnt != sum) die("%s: context count mismatch", sym2str(e->key));
+    printf("%s\t%zu\n", sym2str(e->key), sum);
+    darr_free(e->next);
+  }
+  if (len(total) != len(ctx) - 1) die("%zu words, %zu contexts", len(total), len(ctx) - 1);
+  darr_free(total);
+  darr_free(ctx);
+  symtable_free();
+  msg("done");
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct strcnt_s { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_HASH(s, strcnt_t, char *, d_keyof, d_strmatch, fnv1a, newcnt, d_keyisnull, d_keymknull)
+
+static void addcnt(strcnt_t *d, const strcnt_t *e) { d->cnt += e->cnt; }
+
+#define NSHARD 7
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  dthreads((argc > 2) ? strtoul(argv[2], NULL, 10) : 4);
+  msg("Reading %s into %d shards", fname == NULL ? "stdin" : fname, NSHARD);
+  darr_t shard[NSHARD];
+  for (int i = 0; i < NSHARD; i++) shard[i] = darr(0, strcnt_t);
+  size_t nline = 0;
+  forline (str, fname) {
+    darr_t h = shard[nline++ % NSHARD];
+    fortok (tok, str) {
+      sget(h, tok, true)->cnt++;
+    }
+  }
+  msg("Pairwise merge of shards 0, 1, 2");
+  smerge(shard[1], shard[2], addcnt);
+  darr_free(shard[2]);
+  smerge(shard[0], shard[1], addcnt);
+  darr_free(shard[1]);
+  msg("Parallel merge of the rest using %zu threads", _d_nthreads);
+  smerge_all(shard[0], &shard[3], NSHARD - 3, addcnt);
+  for (int i = 3; i < NSHARD; i++) darr_free(shard[i]);
+  darr_t total = shard[0];
+  msg("len(total)=%zu cap(total)=%zu", len(total), cap(total));
+  forhash (strcnt_t, e, total, d_keyisnull) {
+    if (sget(total, e->key, false) != e) die("%s: lookup mismatch", e->key);
+    printf("%s\t%lu\n", e->key, e->cnt);
+  }
+  darr_free(total);
+  msg("done");
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include "dlib.h"
+
+D_NGRAM2(b)
+D_NGRAM4(t)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  sym_t bos = str2sym("<s>", true), eos = str2sym("</s>", true);
+  darr_t bcnt = darr(0, dngram2_t);
+  darr_t tcnt = darr(0, dngram4_t);
+  size_t ntok = 0;
+  forline (str, fname) {
+    sym_t p2 = bos, p1 = bos;
+    fortok (tok, str) {
+      sym_t u = str2sym(tok, true);
+      bget(bcnt, d_key2(p1, u), true)->cnt++;
+      tget(tcnt, d_key4(p2, p1, u, 0), true)->cnt++;
+      p2 = p1; p1 = u; ntok++;
+    }
+    bget(bcnt, d_key2(p1, eos), true)->cnt++;
+    tget(tcnt, d_key4(p2, p1, eos, 0), true)->cnt++;
+  }
+  msg("%zu tokens, %zu bigrams, %zu trigrams", ntok, len(bcnt), len(tcnt));
+  if (bget(bcnt, d_key2(eos, bos), false) != NULL) die("bget of missing key");
+
+  /* The trigrams with context (a, b) add up to the bigram (a, b),
+     except for (<s>, <s>) which is not counted as a bigram. */
+  ngram4_sort(tcnt);
+  size_t nctx = 0;
+  for (size_t i = 0, j; i < len(tcnt); i = j) {
+    j = ngram4_ctxend(tcnt, i, 3);
+    dngram4_t *e = &(((dngram4_t *) (tcnt->data))[i]);
+    sym_t a = d_key4sym(e->key, 0), b = d_key4sym(e->key, 1);
+    if (d_key4sym(e->key, 3) != 0) die("trigram with a fourth symbol");
+    size_t sum = 0;
+    for (size_t k = i; k < j; k++) sum += e[k - i].cnt;
+    if (b == bos) continue;
+    dngram2_t *f = bget(bcnt, d_key2(a, b), false);
+    if (f == NULL || f->cnt != sum) die("trigram context mismatch: %s %s", sym2str(a), sym2str(b));
+    nctx++;
+  }
+  msg("%zu trigram contexts match their bigrams", nctx);
+
+  /* The bigrams with context w add up to the count of w. */
+  ngram2_sort(bcnt);
+  size_t total = 0;
+  for (size_t i = 0, j; i < len(bcnt); i = j) {
+    j = ngram2_ctxend(bcnt, i, 2);
+    dngram2_t *e = &(((dngram2_t *) (bcnt->data))[i]);
+    if (j < len(bcnt) && d_key2sym(e[j - i].key, 0) == d_key2sym(e->key, 0)) die("context split");
+    size_t sum = 0;
+    for (size_t k = i; k < j; k++) sum += e[k - i].cnt;
+    sym_t w = d_key2sym(e->key, 0);
+    if (w == bos) continue;
+    printf("%s\t%zu\n", sym2str(w), sum);
+    total += sum;
+  }
+  if (total != ntok) die("unigram count mismatch: %zu != %zu", total, ntok);
+  if (ngram2_ctxend(bcnt, 0, 1) != len(bcnt)) die("ngram2_ctxend with n=1");
+  darr_free(bcnt);
+  darr_free(tcnt);
+  symtable_free();
+  msg("done");
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { uint64_t key; uint64_t val; } etype;
+#define einit(k) ((etype) { (k), 0 })
+#define khash(k) ((k) * 0x9E3779B97F4A7C15ULL)
+#define isnull(e) ((e).key == 0)
+#define mknull(e) ((e).key = 0)
+D_HASH(h, etype, uint64_t, d_keyof, d_eqmatch, khash, einit, isnull, mknull)
+D_HASH_LOAD(r, etype, uint64_t, d_keyof, d_eqmatch, khash, einit, isnull, mknull, 8)
+
+int main(int argc, char **argv) {
+  size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+  size_t t = (argc > 2) ? strtoul(argv[2], NULL, 10) : 8;
+  dthreads(t);
+  msg("Inserting %zu keys using %zu threads", n, _d_nthreads);
+  darr_t a = darr(0, etype);
+  for (uint64_t k = 1; k <= n; k++) {
+    hget(a, k, true)->val = k;
+  }
+  msg("len(a)=%zu cap(a)=%zu", len(a), cap(a));
+  for (uint64_t k = 1; k <= n; k++) {
+    etype *e = hget(a, k, false);
+    if (e == NULL || e->val != k) die("Cannot find %lu", k);
+  }
+  if (hget(a, n + 1, false) != NULL) die("Found %lu", n + 1);
+  darr_free(a);
+  msg("Reserving for %zu keys at load factor 8/16", n);
+  darr_t b = darr(0, etype);
+  rreserve(b, n);
+  size_t c = cap(b);
+  for (uint64_t k = 1; k <= n; k++) {
+    rget(b, k, true)->val = k;
+  }
+  msg("len(b)=%zu cap(b)=%zu", len(b), cap(b));
+  if (cap(b) != c) die("Table resized after rreserve");
+  if (cap(b) < 2 * n) die("Load factor above 8/16");
+  darr_free(b);
+  msg("done");
+}
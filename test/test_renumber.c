@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct symcnt_s { sym_t key; uint32_t cnt; } symcnt_t;
+#define newsym(k) ((symcnt_t) { (k), 0 })
+#define symisnull(e) ((e).key == 0)
+#define symmknull(e) ((e).key = 0)
+D_HASH(y, symcnt_t, sym_t, d_keyof, d_eqmatch, d_mix64, newsym, symisnull, symmknull)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t toks = darr(0, sym_t);
+  darr_t cnt = darr(0, size_t);
+  darr_t ytable = darr(0, symcnt_t);
+  str2sym("<unused>", true);
+  forline (str, fname) {
+    fortok (tok, str) {
+      sym_t u = str2sym(tok, true);
+      val(toks, len(toks), sym_t) = u;
+      while (u >= len(cnt)) val(cnt, len(cnt), size_t) = 0;
+      val(cnt, u, size_t)++;
+      yget(ytable, u, true)->cnt++;
+    }
+  }
+  size_t ntok = len(toks);
+  str_t first = strdup(sym2str(((sym_t *) toks->data)[0]));
+  msg("Renumbering %zu symbols by count", len(cnt) - 1);
+  darr_t map = symtable_renumber(cnt, true);
+  if (((sym_t *) map->data)[1] != 0 || str2sym("<unused>", false) != 0) die("unused symbol not dropped");
+  sym_remap(toks->data, ntok, map);
+  forhash (symcnt_t, e, ytable, symisnull) {
+    e->key = val(map, e->key, sym_t);
+  }
+  yrekey(ytable);
+  if (strcmp(sym2str(((sym_t *) toks->data)[0]), first)) die("remapped token mismatch");
+  uint32_t prev = UINT32_MAX;
+  for (sym_t u = 1; sym2str(u) != NULL; u++) {
+    symcnt_t *e = yget(ytable, u, false);
+    if ((e == NULL) || (e->cnt > prev) || (str2sym(sym2str(u), false) != u)) die("%u: renumbering mismatch", u);
+    prev = e->cnt;
+  }
+  forhash (symcnt_t, e, ytable, symisnull) {
+    printf("%s\t%u\n", sym2str(e->key), e->cnt);
+  }
+  darr_free(map); darr_free(cnt); darr_free(toks); darr_free(ytable);
+  symtable_free();
+  msg("done");
+}
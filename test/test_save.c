@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "dlib.h"
+
+typedef struct strcnt_s { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+typedef struct symcnt_s { sym_t key; uint32_t cnt; } symcnt_t;
+#define newsym(k) ((symcnt_t) { (k), 0 })
+#define symisnull(e) ((e).key == 0)
+#define symmknull(e) ((e).key = 0)
+D_HASH(y, symcnt_t, sym_t, d_keyof, d_eqmatch, d_mix64, newsym, symisnull, symmknull)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  char *dir = (argc > 2) ? argv[2] : "/tmp";
+  char path[4][1024];
+  for (int i = 0; i < 4; i++) sprintf(path[i], "%s/test_save.%d.%d", dir, (int) getpid(), i);
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t htable = darr(0, strcnt_t);
+  darr_t ytable = darr(0, symcnt_t);
+  darr_t lens = darr(0, uint32_t);
+  forline (str, fname) {
+    val(lens, len(lens), uint32_t) = strlen(str);
+    fortok (tok, str) {
+      sget(htable, tok, true)->cnt++;
+      yget(ytable, str2sym(tok, true), true)->cnt++;
+    }
+  }
+  msg("Saving %zu words, %zu syms, %zu lines", len(htable), len(ytable), len(lens));
+  darr_t frozen = sfreeze(htable);
+  ssave(htable, path[0]);
+  sfsave(frozen, path[1]);
+  ysave(ytable, path[2]);
+  darr_save(lens, uint32_t, path[3]);
+  msg("Mapping");
+  darr_t h = smmap(path[0]), f = smmap(path[1]), y = ymmap(path[2]), l = darr_mmap(path[3], uint32_t);
+  if ((len(h) != len(htable)) || (len(f) != len(frozen)) || (len(y) != len(ytable)) || (len(l) != len(lens)))
+    die("length mismatch");
+  for (size_t i = 0; i < len(l); i++)
+    if (val(l, i, uint32_t) != val(lens, i, uint32_t)) die("lens[%zu] mismatch", i);
+  forhash (strcnt_t, e, htable, d_keyisnull) {
+    strcnt_t *a = smget(h, e->key), *b = smfget(f, e->key);
+    symcnt_t *c = yget(y, str2sym(e->key, false), false);
+    if ((a == NULL) || (b == NULL) || (c == NULL) || (a->cnt != e->cnt) || (b->cnt != e->cnt) || (c->cnt != e->cnt))
+      die("%s: mapped lookup mismatch", e->key);
+  }
+  if ((smget(h, "") != NULL) || (smfget(f, "") != NULL)) die("empty key found");
+  forhash (strcnt_t, e, h, d_keyisnull) {
+    printf("%s\t%zu\n", smkey(h, e), e->cnt);
+  }
+  darr_unmap(h); darr_unmap(f); darr_unmap(y); darr_unmap(l);
+  for (int i = 0; i < 4; i++) unlink(path[i]);
+  msg("done");
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+D_STRHASH(s, strcnt_t, newcnt)
+
+static size_t wyhash0(const char *k) { return wyhash(k, strlen(k), 0); }
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  size_t nbytes = (argc > 2) ? strtoul(argv[2], NULL, 10) : (1 << 16);
+  size_t k = (argc > 3) ? strtoul(argv[3], NULL, 10) : 100;
+  msg("Reading %s into a %zu byte sketch with %zu heavy hitters", fname == NULL ? "stdin" : fname, nbytes, k);
+  darr_t cnt = darr(0, strcnt_t);
+  dsketch_t s1 = sketch_new(nbytes, k, NULL);
+  dsketch_t s2 = sketch_new(nbytes, k, wyhash0);
+  size_t ntok = 0;
+  forline (str, fname) {
+    fortok (tok, str) {
+      sget(cnt, tok, true)->cnt++;
+      sketch_add(s1, tok, 1);
+      sketch_addh(s2, tok, wyhash(tok, strlen(tok), 0), 1);
+      ntok++;
+    }
+  }
+  msg("%zu tokens, %zu words", ntok, len(cnt));
+  size_t over = 0, maxover = 0;
+  forhash (strcnt_t, e, cnt, d_keyisnull) {
+    size_t e1 = sketch_get(s1, e->key), e2 = sketch_get(s2, e->key);
+    if (e1 < e->cnt || e2 < e->cnt) die("%s: estimate below count", e->key);
+    over += e1 - e->cnt;
+    if (e1 - e->cnt > maxover) maxover = e1 - e->cnt;
+  }
+  msg("average overestimate %g, maximum %zu", (double) over / len(cnt), maxover);
+  darr_t top = sketch_top(s1);
+  if (len(top) != k) die("len(top)=%zu", len(top));
+  for (size_t i = 0; i < len(top); i++) {
+    dheavy_t *h = &val(top, i, dheavy_t);
+    size_t c = sget(cnt, h->key, false)->cnt;
+    if (c > h->cnt || c < h->cnt - h->err) die("%s: %zu not in [%zu, %zu]", h->key, c, h->cnt - h->err, h->cnt);
+    if (i > 0 && h->cnt > val(top, i - 1, dheavy_t).cnt) die("sketch_top not sorted");
+    printf("%s\t%zu\t%zu\n", h->key, h->cnt, c);
+  }
+  forhash (strcnt_t, e, cnt, d_keyisnull) {
+    if (e->cnt * k <= ntok) continue;
+    size_t i = 0;
+    while (i < len(top) && strcmp(val(top, i, dheavy_t).key, e->key)) i++;
+    if (i == len(top)) die("%s: count %zu > N/k but not in top", e->key, e->cnt);
+  }
+  darr_free(top);
+  sketch_free(s1);
+  sketch_free(s2);
+  darr_free(cnt);
+  msg("done");
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include "dlib.h"
+
+D_SYMMAP(c, uint32_t, d_zero)
+
+#define newmap(k) cnew(0)
+D_SYMMAP(b, dsymmap_t, newmap)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  dsymmap_t cnt = cnew(0);
+  dsymmap_t next = bnew(0);
+  size_t nbigram = 0;
+  forline (str, fname) {
+    sym_t prev = 0;
+    fortok (tok, str) {
+      sym_t u = str2sym(tok, true);
+      (*cget(cnt, u, true))++;
+      if (prev != 0) {
+	(*cget(*bget(next, prev, true), u, true))++;
+	nbigram++;
+      }
+      prev = u;
+    }
+  }
+  msg("len(cnt)=%zu dense=%d len(next)=%zu dense=%d", len(&cnt->a), cnt->dense, len(&next->a), next->dense);
+  size_t ndense = 0, nkeys = 0, total = 0;
+  forsymmap (b, k, m, next) {
+    if (bget(next, k, false) != m) die("%zu: bget mismatch", k);
+    ndense += (*m)->dense;
+    nkeys += len(&(*m)->a);
+    forsymmap (c, k2, v, *m) {
+      if (cget(*m, k2, false) != v) die("%zu %zu: cget mismatch", k, k2);
+      total += *v;
+    }
+    dsymmap_free(*m);
+  }
+  msg("%zu bigram types in %zu maps (%zu dense)", nkeys, len(&next->a), ndense);
+  if (total != nbigram) die("bigram count mismatch: %zu != %zu", total, nbigram);
+  if (cget(cnt, 0, false) != NULL || cget(cnt, UINT32_MAX, false) != NULL) die("cget of missing key");
+  if (cget(cnt, 0, true) != NULL) die("cget inserted key 0");
+  dsymmap_t far = cnew(100);
+  for (sym_t k = 1; k <= 1000; k++) *cget(far, k * 3000000u, true) = k;
+  if (far->dense || len(&far->a) != 1000) die("sparse keys made the map dense");
+  for (sym_t k = 1; k <= 1000; k++)
+    if (*cget(far, k * 3000000u, false) != k) die("%u: far key lost", k);
+  dsymmap_free(far);
+  forsymmap (c, k, v, cnt) {
+    printf("%s\t%u\n", sym2str(k), *v);
+  }
+  dsymmap_free(next);
+  dsymmap_free(cnt);
+  msg("done");
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "dlib.h"
+
+typedef struct symcnt_s { sym_t key; uint32_t cnt; } symcnt_t;
+#define newsym(k) ((symcnt_t) { (k), 0 })
+#define symisnull(e) ((e).key == 0)
+#define symmknull(e) ((e).key = 0)
+D_HASH(y, symcnt_t, sym_t, d_keyof, d_eqmatch, d_mix64, newsym, symisnull, symmknull)
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  char path[1024];
+  sprintf(path, "%s/test_symsave.%d", (argc > 2) ? argv[2] : "/tmp", (int) getpid());
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t ytable = darr(0, symcnt_t);
+  forline (str, fname) {
+    fortok (tok, str) {
+      yget(ytable, str2sym(tok, true), true)->cnt++;
+    }
+  }
+  size_t nsym = len(ytable);
+  msg("Saving %zu symbols to %s", nsym, path);
+  symtable_save(path);
+  darr_t strs = darr(nsym, str_t);
+  for (sym_t u = 1; u <= nsym; u++) val(strs, u - 1, str_t) = strdup(sym2str(u));
+  str_t *str = (str_t *) strs->data;
+  symtable_free();
+  if (str2sym(str[0], false) != 0) die("symtable_free failed");
+  symtable_free();
+  msg("Loading %s", path);
+  symtable_load(path);
+  msg("Loaded");
+  for (sym_t u = 1; u <= nsym; u++) {
+    str_t s = str[u - 1];
+    if ((str2sym(s, false) != u) || (str2sym(s, true) != u) || strcmp(sym2str(u), s))
+      die("%s: loaded symbol mismatch", s);
+  }
+  forhash (symcnt_t, e, ytable, symisnull) {
+    printf("%s\t%u\n", sym2str(e->key), e->cnt);
+  }
+  sym_t u = str2sym("no such word in the corpus", true);
+  if ((u != nsym + 1) || (str2sym(str[0], false) != 1) ||
+      strcmp(sym2str(nsym), str[nsym - 1]))
+    die("insert after load failed");
+  symtable_free();
+  symtable_load(path);
+  symtable_freeze();
+  if ((str2sym(str[0], false) != 1) || (str2sym("no such word in the corpus", true) != u))
+    die("freeze after load failed");
+  symtable_free();
+  unlink(path);
+  msg("done");
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct { darr_t lines; symtab_t t; darr_t *cnt; } args_t;
+
+static void intern(void *arg, size_t tid, size_t n) {
+  args_t *a = (args_t *) arg;
+  darr_t cnt = a->cnt[tid] = darr(0, uint32_t);
+  for (size_t i = tid; i < len(a->lines); i += n) {
+    fortok (tok, val(a->lines, i, str_t)) {
+      sym_t u = symtab_str2sym(a->t, tok, true);
+      if (strcmp(symtab_sym2str(a->t, u), tok)) die("%s: sym2str mismatch", tok);
+      while (u >= len(cnt)) val(cnt, len(cnt), uint32_t) = 0;
+      val(cnt, u, uint32_t)++;
+    }
+    size_t m = symtab_len(a->t);
+    if (symtab_sym2str(a->t, m) == NULL) die("%zu: sym2str of the newest symbol is NULL", m);
+  }
+}
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  dthreads((argc > 2) ? strtoul(argv[2], NULL, 10) : 4);
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  args_t a = { darr(0, str_t), symtab_new(), NULL };
+  forline (str, fname) {
+    val(a.lines, len(a.lines), str_t) = strdup(str);
+  }
+  msg("Interning %zu lines with %zu threads", len(a.lines), _d_nthreads);
+  a.cnt = malloc(_d_nthreads * sizeof(darr_t));
+  _d_parallel(intern, &a);
+  size_t n = symtab_len(a.t);
+  msg("symtab_len=%zu", n);
+  for (sym_t u = 1; u <= n; u++) {
+    str_t s = symtab_sym2str(a.t, u);
+    if ((s == NULL) || (symtab_str2sym(a.t, s, false) != u)) die("%u: str2sym mismatch", u);
+    size_t c = 0;
+    for (size_t i = 0; i < _d_nthreads; i++)
+      if (u < len(a.cnt[i])) c += val(a.cnt[i], u, uint32_t);
+    printf("%s\t%zu\n", s, c);
+  }
+  if (symtab_str2sym(a.t, "no such word in the corpus", false) != 0) die("lookup of missing key");
+  for (size_t i = 0; i < _d_nthreads; i++) darr_free(a.cnt[i]);
+  symtab_free(a.t);
+  msg("done");
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include "dlib.h"
+
+typedef struct strcnt_s { char *key; size_t cnt; } strcnt_t;
+#define newcnt(k) ((strcnt_t) { strdup(k), 0 })
+
+D_TAGHASH(s, strcnt_t, char *, d_keyof, d_strmatch, fnv1a, newcnt, d_keyisnull, d_keymknull)
+
+#define cnt(k) sget(htable, (k), true)->cnt
+
+int main(int argc, char **argv) {
+  char *fname = (argc == 1) ? NULL : argv[1];
+  msg("Reading %s", fname == NULL ? "stdin" : fname);
+  darr_t htable = darr(0, strcnt_t);
+  forline (str, fname) {
+    fortok (tok, str) {
+      cnt(tok)++;
+    }
+  }
+  msg("len(htable)=%zu cap(htable)=%zu", len(htable), cap(htable));
+  forhash (strcnt_t, e, htable, d_keyisnull) {
+    if (sget(htable, e->key, false) != e) die("%s: lookup mismatch", e->key);
+    printf("%s\t%lu\n", e->key, e->cnt);
+  }
+  if (sget(htable, "no such word in here", false) != NULL) die("found missing key");
+  msg("done");
+}